@@ -64,6 +64,37 @@
 /* Default snap margin in pixels. Used unless -s width. */
 #define SNAPMARGIN 0
 
+/*
+ * Max number of times per second to move or resize a window while
+ * dragging it with the mouse. 0 means as often as the pointer moves,
+ * and anything above 1000 means 1000.
+ * Can be set from command line with "-r rate".
+ */
+#define DRAGRATE 0
+
+/*
+ * Number of workspaces. MODKEY + 1 to 0 go to the first ten, MODKEY +
+ * c and v walk through all of them. Can be set from command line
+ * with "-w workspaces".
+ */
+#define WORKSPACES 10
+
+/*
+ * Change workspaces atomically: grab the server, map the new windows
+ * and then unmap the old ones. Avoids flicker and lets clients repaint
+ * once, but other clients are stopped for the duration of the switch.
+ * Set to false to unmap first and map later without grabbing.
+ */
+#define ATOMICSWITCH true
+
+/*
+ * Milliseconds to wait after the last monitor or root geometry change
+ * before rearranging windows. Docking a laptop sends many changes in
+ * a row and we only want to act on the last one. 0 means act on every
+ * change at once. Can be set from command line with "-S msec".
+ */
+#define SETTLETIME 200
+
 /*
  * Keysym codes for window operations. Look in X11/keysymdefs.h for
  * actual symbols. Use XK_VoidSymbol to disable a function.
@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "edges.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif
+
+#ifdef DEBUG
+#define PDEBUG(Args...) \
+  do { fprintf(stderr, "mcwm: "); fprintf(stderr, ##Args); } while(0)
+#define D(x) x
+#else
+#define PDEBUG(Args...)
+#define D(x)
+#endif
+
+/*
+ * Initialize an empty edge index.
+ */
+void edgeinit(struct edgeindex *idx)
+{
+    idx->edges = NULL;
+    idx->num = 0;
+    idx->size = 0;
+}
+
+/*
+ * Add an edge at pos covering from to to to idx.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int edgeadd(struct edgeindex *idx, int32_t pos, int32_t from, int32_t to)
+{
+    struct edge *edges;
+    uint32_t size;
+
+    if (idx->num == idx->size)
+    {
+        size = 0 == idx->size ? 32 : idx->size * 2;
+        edges = realloc(idx->edges, size * sizeof (struct edge));
+        if (NULL == edges)
+        {
+            return -1;
+        }
+
+        idx->edges = edges;
+        idx->size = size;
+    }
+
+    idx->edges[idx->num].pos = pos;
+    idx->edges[idx->num].from = from;
+    idx->edges[idx->num].to = to;
+    idx->num ++;
+
+    return 0;
+}
+
+static int edgecmp(const void *a, const void *b)
+{
+    const struct edge *ea = a;
+    const struct edge *eb = b;
+
+    if (ea->pos < eb->pos)
+    {
+        return -1;
+    }
+
+    if (ea->pos > eb->pos)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Sort idx on position. Call after adding edges and before using
+ * edgefind().
+ */
+void edgesort(struct edgeindex *idx)
+{
+    if (idx->num > 1)
+    {
+        qsort(idx->edges, idx->num, sizeof (struct edge), edgecmp);
+    }
+}
+
+/*
+ * Find the edge in idx closest to pos, less than margin away, that
+ * overlaps from to to.
+ *
+ * Returns 1 and stores the edge's position in *found if there is one,
+ * otherwise 0.
+ */
+int edgefind(const struct edgeindex *idx, int32_t pos, int32_t margin,
+             int32_t from, int32_t to, int32_t *found)
+{
+    uint32_t low = 0;
+    uint32_t high = idx->num;
+    uint32_t mid;
+    uint32_t i;
+    int32_t dist;
+    int32_t best = margin;
+
+    /* Binary search for the first edge more than -margin away. */
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+        if (idx->edges[mid].pos <= pos - margin)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    /* Only the edges within the margin are left to check. */
+    for (i = low; i < idx->num && idx->edges[i].pos < pos + margin; i ++)
+    {
+        if (to <= idx->edges[i].from || from >= idx->edges[i].to)
+        {
+            /* Doesn't overlap. */
+            continue;
+        }
+
+        dist = abs(idx->edges[i].pos - pos);
+        if (dist < best)
+        {
+            best = dist;
+            *found = idx->edges[i].pos;
+        }
+    }
+
+    return best < margin;
+}
+
+/*
+ * Forget all edges in idx but keep the memory.
+ */
+void edgeclear(struct edgeindex *idx)
+{
+    idx->num = 0;
+}
+
+/*
+ * Free all memory used by idx.
+ */
+void edgefree(struct edgeindex *idx)
+{
+    free(idx->edges);
+    edgeinit(idx);
+}
+
+#ifdef EDGEBENCH
+
+/*
+ * Micro benchmark comparing snapping a dragged window against every
+ * window on the workspace with looking it up in edge indexes. Build
+ * with:
+ *
+ *   cc -O2 -DEDGEBENCH edges.c -o edgebench
+ */
+
+#include <time.h>
+
+#define MARGIN 10
+
+struct rect
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Snap r against all windows, the way mcwm used to. */
+static void snapscan(struct rect *r, const struct rect *wins, uint32_t num)
+{
+    uint32_t i;
+    const struct rect *w;
+
+    for (i = 0; i < num; i ++)
+    {
+        w = &wins[i];
+
+        if (abs((w->x + w->width) - r->x) < MARGIN
+            && r->y + r->height > w->y && r->y < w->y + w->height)
+        {
+            r->x = w->x + w->width;
+        }
+
+        if (abs((w->y + w->height) - r->y) < MARGIN
+            && r->x + r->width > w->x && r->x < w->x + w->width)
+        {
+            r->y = w->y + w->height;
+        }
+
+        if (abs((r->x + r->width) - w->x) < MARGIN
+            && r->y + r->height > w->y && r->y < w->y + w->height)
+        {
+            r->x = w->x - r->width;
+        }
+
+        if (abs((r->y + r->height) - w->y) < MARGIN
+            && r->x + r->width > w->x && r->x < w->x + w->width)
+        {
+            r->y = w->y - r->height;
+        }
+    }
+}
+
+/* Snap r using the four edge indexes. */
+static void snapindex(struct rect *r, const struct edgeindex *idx)
+{
+    int32_t pos;
+
+    if (edgefind(&idx[0], r->x, MARGIN, r->y, r->y + r->height, &pos))
+    {
+        r->x = pos;
+    }
+
+    if (edgefind(&idx[1], r->y, MARGIN, r->x, r->x + r->width, &pos))
+    {
+        r->y = pos;
+    }
+
+    if (edgefind(&idx[2], r->x + r->width, MARGIN, r->y, r->y + r->height,
+                 &pos))
+    {
+        r->x = pos - r->width;
+    }
+
+    if (edgefind(&idx[3], r->y + r->height, MARGIN, r->x, r->x + r->width,
+                 &pos))
+    {
+        r->y = pos - r->height;
+    }
+}
+
+int main(void)
+{
+    const uint32_t counts[] = { 10, 50, 100, 200, 500, 1000, 2000 };
+    const int frames = 200000;
+    unsigned c;
+
+    printf("windows  scan ns/frame  index ns/frame  build us\n");
+
+    for (c = 0; c < sizeof counts / sizeof counts[0]; c ++)
+    {
+        struct edgeindex idx[4];
+        struct rect *wins;
+        struct rect r;
+        volatile int32_t sink = 0;
+        double start;
+        double scanns;
+        double indexns;
+        double buildus;
+        uint32_t i;
+        int n;
+
+        wins = calloc(counts[c], sizeof (struct rect));
+        if (NULL == wins)
+        {
+            exit(1);
+        }
+
+        srand(1);
+        for (i = 0; i < counts[c]; i ++)
+        {
+            wins[i].x = rand() % 3600;
+            wins[i].y = rand() % 2000;
+            wins[i].width = 100 + rand() % 600;
+            wins[i].height = 100 + rand() % 400;
+        }
+
+        /* This is what mcwm does when a drag starts. */
+        start = now();
+        for (i = 0; i < 4; i ++)
+        {
+            edgeinit(&idx[i]);
+        }
+        for (i = 0; i < counts[c]; i ++)
+        {
+            const struct rect *w = &wins[i];
+
+            if (0 != edgeadd(&idx[0], w->x + w->width, w->y, w->y + w->height)
+                || 0 != edgeadd(&idx[1], w->y + w->height, w->x,
+                                w->x + w->width)
+                || 0 != edgeadd(&idx[2], w->x, w->y, w->y + w->height)
+                || 0 != edgeadd(&idx[3], w->y, w->x, w->x + w->width))
+            {
+                exit(1);
+            }
+        }
+        for (i = 0; i < 4; i ++)
+        {
+            edgesort(&idx[i]);
+        }
+        buildus = (now() - start) / 1000;
+
+        start = now();
+        for (n = 0; n < frames; n ++)
+        {
+            r.x = (n * 7) % 3600;
+            r.y = (n * 13) % 2000;
+            r.width = 500;
+            r.height = 300;
+            snapscan(&r, wins, counts[c]);
+            sink += r.x + r.y;
+        }
+        scanns = (now() - start) / frames;
+
+        start = now();
+        for (n = 0; n < frames; n ++)
+        {
+            r.x = (n * 7) % 3600;
+            r.y = (n * 13) % 2000;
+            r.width = 500;
+            r.height = 300;
+            snapindex(&r, idx);
+            sink += r.x + r.y;
+        }
+        indexns = (now() - start) / frames;
+
+        printf("%7u  %13.1f  %14.1f  %8.1f\n", counts[c], scanns, indexns,
+               buildus);
+
+        for (i = 0; i < 4; i ++)
+        {
+            edgefree(&idx[i]);
+        }
+        free(wins);
+    }
+
+    exit(0);
+}
+
+#endif /* EDGEBENCH */
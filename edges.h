@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+/*
+ * A horizontal or vertical window edge at pos, covering from up to,
+ * but not including, to along the other axis.
+ */
+struct edge
+{
+    int32_t pos;
+    int32_t from;
+    int32_t to;
+};
+
+/*
+ * Edges sorted on pos so we can find the ones close to a position
+ * without looking at all of them. Add edges, then sort them once
+ * before looking anything up.
+ */
+struct edgeindex
+{
+    struct edge *edges;
+    uint32_t num;               /* Number of edges stored. */
+    uint32_t size;              /* Room for this many edges. */
+};
+
+/*
+ * Initialize an empty edge index.
+ */
+void edgeinit(struct edgeindex *idx);
+
+/*
+ * Add an edge at pos covering from to to to idx.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int edgeadd(struct edgeindex *idx, int32_t pos, int32_t from, int32_t to);
+
+/*
+ * Sort idx on position. Call after adding edges and before using
+ * edgefind().
+ */
+void edgesort(struct edgeindex *idx);
+
+/*
+ * Find the edge in idx closest to pos, less than margin away, that
+ * overlaps from to to.
+ *
+ * Returns 1 and stores the edge's position in *found if there is one,
+ * otherwise 0.
+ */
+int edgefind(const struct edgeindex *idx, int32_t pos, int32_t margin,
+             int32_t from, int32_t to, int32_t *found);
+
+/*
+ * Forget all edges in idx but keep the memory.
+ */
+void edgeclear(struct edgeindex *idx);
+
+/*
+ * Free all memory used by idx.
+ */
+void edgefree(struct edgeindex *idx);
@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hash.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif
+
+#ifdef DEBUG
+#define PDEBUG(Args...) \
+  do { fprintf(stderr, "mcwm: "); fprintf(stderr, ##Args); } while(0)
+#define D(x) x
+#else
+#define PDEBUG(Args...)
+#define D(x)
+#endif
+
+/* Never let the table get more than half full. */
+#define HASH_MAXLOAD(size) ((size) / 2)
+
+/*
+ * Spread the bits of key over the whole table. Window IDs from one
+ * client share the high bits and differ in a few low bits, in small
+ * steps, so every bit of the key has to affect the slot. This is the
+ * final mix of MurmurHash3.
+ */
+static uint32_t hashslot(const struct hashtab *tab, uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+
+    return key & (tab->size - 1);
+}
+
+/*
+ * Initialize hash table tab with room for at least size keys.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int hashinit(struct hashtab *tab, uint32_t size)
+{
+    uint32_t slots;
+
+    for (slots = 16; HASH_MAXLOAD(slots) < size; slots *= 2)
+        ;
+
+    tab->slots = calloc(slots, sizeof (struct hashslot));
+    if (NULL == tab->slots)
+    {
+        tab->size = 0;
+        tab->used = 0;
+        return -1;
+    }
+
+    tab->size = slots;
+    tab->used = 0;
+
+    return 0;
+}
+
+/*
+ * Double the number of slots in tab and move all keys.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int hashgrow(struct hashtab *tab)
+{
+    struct hashtab new;
+    uint32_t i;
+
+    if (0 != hashinit(&new, tab->size))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < tab->size; i ++)
+    {
+        if (0 != tab->slots[i].key)
+        {
+            hashadd(&new, tab->slots[i].key, tab->slots[i].data);
+        }
+    }
+
+    free(tab->slots);
+    *tab = new;
+
+    return 0;
+}
+
+/*
+ * Store data under key in tab, replacing anything stored there
+ * before.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int hashadd(struct hashtab *tab, uint32_t key, void *data)
+{
+    uint32_t i;
+
+    if (0 == key)
+    {
+        return -1;
+    }
+
+    if (tab->used + 1 > HASH_MAXLOAD(tab->size))
+    {
+        if (0 != hashgrow(tab))
+        {
+            return -1;
+        }
+    }
+
+    /* Linear probing. Stop at the key or the first empty slot. */
+    for (i = hashslot(tab, key); 0 != tab->slots[i].key;
+         i = (i + 1) & (tab->size - 1))
+    {
+        if (key == tab->slots[i].key)
+        {
+            tab->slots[i].data = data;
+            return 0;
+        }
+    }
+
+    tab->slots[i].key = key;
+    tab->slots[i].data = data;
+    tab->used ++;
+
+    return 0;
+}
+
+/*
+ * Find data stored under key in tab.
+ *
+ * Returns data or NULL if not found.
+ */
+void *hashfind(const struct hashtab *tab, uint32_t key)
+{
+    uint32_t i;
+
+    if (0 == key || 0 == tab->size)
+    {
+        return NULL;
+    }
+
+    for (i = hashslot(tab, key); 0 != tab->slots[i].key;
+         i = (i + 1) & (tab->size - 1))
+    {
+        if (key == tab->slots[i].key)
+        {
+            return tab->slots[i].data;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Delete key from tab. It's not an error if key isn't there.
+ *
+ * We don't use tombstones. Instead we move back any following keys
+ * in the same probe run that would otherwise become unreachable.
+ */
+void hashdel(struct hashtab *tab, uint32_t key)
+{
+    uint32_t mask = tab->size - 1;
+    uint32_t i;
+    uint32_t j;
+    uint32_t home;
+
+    if (0 == key || 0 == tab->size)
+    {
+        return;
+    }
+
+    for (i = hashslot(tab, key); key != tab->slots[i].key; i = (i + 1) & mask)
+    {
+        if (0 == tab->slots[i].key)
+        {
+            /* Not found. */
+            return;
+        }
+    }
+
+    for (j = (i + 1) & mask; 0 != tab->slots[j].key; j = (j + 1) & mask)
+    {
+        home = hashslot(tab, tab->slots[j].key);
+
+        /*
+         * Move the key at j into the hole at i unless its home slot
+         * lies cyclically in (i, j].
+         */
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            tab->slots[i] = tab->slots[j];
+            i = j;
+        }
+    }
+
+    tab->slots[i].key = 0;
+    tab->slots[i].data = NULL;
+    tab->used --;
+}
+
+/*
+ * Forget all keys in tab but keep the memory.
+ */
+void hashclear(struct hashtab *tab)
+{
+    if (0 != tab->used)
+    {
+        memset(tab->slots, 0, tab->size * sizeof (struct hashslot));
+        tab->used = 0;
+    }
+}
+
+/*
+ * Free all memory used by tab.
+ */
+void hashfree(struct hashtab *tab)
+{
+    free(tab->slots);
+    tab->slots = NULL;
+    tab->size = 0;
+    tab->used = 0;
+}
+
+#ifdef HASHBENCH
+
+/*
+ * Micro benchmark comparing lookups in the hash table with walking a
+ * list the way we used to find clients. Build with:
+ *
+ *   cc -O2 -DHASHBENCH hash.c list.c -o hashbench
+ */
+
+#include <time.h>
+#include "list.h"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    const uint32_t counts[] = { 10, 50, 100, 200, 500, 1000, 2000 };
+    const int lookups = 1000000;
+    unsigned c;
+
+    printf("windows  list ns/lookup  hash ns/lookup  probes/lookup\n");
+
+    for (c = 0; c < sizeof counts / sizeof counts[0]; c ++)
+    {
+        struct hashtab tab;
+        struct item *list = NULL;
+        struct item *item;
+        uint32_t *ids;
+        uint32_t i;
+        volatile uintptr_t sink = 0;
+        double start;
+        double listns;
+        double hashns;
+        double probes;
+        int n;
+
+        ids = calloc(counts[c], sizeof (uint32_t));
+        if (NULL == ids || 0 != hashinit(&tab, 0))
+        {
+            exit(1);
+        }
+
+        for (i = 0; i < counts[c]; i ++)
+        {
+            /*
+             * Looks like window IDs from eight clients. Every client
+             * has its own base with the low 21 bits clear and
+             * allocates IDs upwards in steps of 4 to 32, since it
+             * makes pixmaps and other things in between.
+             */
+            ids[i] = ((5 + i % 8) << 21) + 1 + (i / 8) * (4 << i % 4);
+
+            if (NULL == (item = additem(&list)))
+            {
+                exit(1);
+            }
+            item->data = &ids[i];
+            hashadd(&tab, ids[i], &ids[i]);
+        }
+
+        start = now();
+        for (n = 0; n < lookups; n ++)
+        {
+            uint32_t key = ids[(n * 7919u) % counts[c]];
+
+            for (item = list; item != NULL; item = item->next)
+            {
+                if (*(uint32_t *)item->data == key)
+                {
+                    sink += (uintptr_t) item->data;
+                    break;
+                }
+            }
+        }
+        listns = (now() - start) / lookups;
+
+        start = now();
+        for (n = 0; n < lookups; n ++)
+        {
+            sink += (uintptr_t) hashfind(&tab, ids[(n * 7919u) % counts[c]]);
+        }
+        hashns = (now() - start) / lookups;
+
+        /* Slots we look at to find a key, on average. */
+        probes = 0;
+        for (i = 0; i < counts[c]; i ++)
+        {
+            uint32_t slot;
+
+            for (slot = hashslot(&tab, ids[i]); ids[i] != tab.slots[slot].key;
+                 slot = (slot + 1) & (tab.size - 1))
+            {
+                probes ++;
+            }
+            probes ++;
+        }
+        probes /= counts[c];
+
+        printf("%7u  %14.1f  %14.1f  %13.2f\n", counts[c], listns, hashns,
+               probes);
+
+        while (NULL != list)
+        {
+            delitem(&list, list);
+        }
+        hashfree(&tab);
+        free(ids);
+    }
+
+    exit(0);
+}
+
+#endif /* HASHBENCH */
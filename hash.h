@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+/* One slot in a hash table. A key of 0 means the slot is empty. */
+struct hashslot
+{
+    uint32_t key;
+    void *data;
+};
+
+/*
+ * Open addressing hash table mapping 32 bit keys, such as window IDs,
+ * to data. The key 0 can't be stored.
+ */
+struct hashtab
+{
+    struct hashslot *slots;
+    uint32_t size;              /* Number of slots. Always a power of 2. */
+    uint32_t used;              /* Number of keys stored. */
+};
+
+/*
+ * Initialize hash table tab with room for at least size keys.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int hashinit(struct hashtab *tab, uint32_t size);
+
+/*
+ * Store data under key in tab, replacing anything stored there
+ * before.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int hashadd(struct hashtab *tab, uint32_t key, void *data);
+
+/*
+ * Find data stored under key in tab.
+ *
+ * Returns data or NULL if not found.
+ */
+void *hashfind(const struct hashtab *tab, uint32_t key);
+
+/*
+ * Delete key from tab. It's not an error if key isn't there.
+ */
+void hashdel(struct hashtab *tab, uint32_t key);
+
+/*
+ * Forget all keys in tab but keep the memory.
+ */
+void hashclear(struct hashtab *tab);
+
+/*
+ * Free all memory used by tab.
+ */
+void hashfree(struct hashtab *tab);
@@ -55,6 +55,52 @@ void movetohead(struct item **mainlist, struct item *item)
     *mainlist = item;
 }
 
+/*
+ * Move element next so it comes right after item in list mainlist.
+ */
+void movetonext(struct item **mainlist, struct item *item,
+                struct item *next)
+{
+    if (NULL == item || NULL == next || NULL == mainlist
+        || NULL == *mainlist)
+    {
+        return;
+    }
+
+    if (item == next || item->next == next)
+    {
+        /* Already there. Do nothing. */
+        return;
+    }
+
+    /* Braid together the list where next is now. */
+    if (NULL != next->prev)
+    {
+        next->prev->next = next->next;
+    }
+    else
+    {
+        /* next was head. */
+        *mainlist = next->next;
+    }
+
+    if (NULL != next->next)
+    {
+        next->next->prev = next->prev;
+    }
+
+    /* Put it after item. */
+    next->prev = item;
+    next->next = item->next;
+
+    if (NULL != item->next)
+    {
+        item->next->prev = next;
+    }
+
+    item->next = next;
+}
+
 /*
  * Create space for a new item and add it to the head of mainlist.
  *
@@ -103,6 +149,12 @@ void delitem(struct item **mainlist, struct item *item)
     {
         /* First entry was removed. Remember the next one instead. */
         *mainlist = ml->next;
+
+        if (NULL != *mainlist)
+        {
+            /* The new head has no one before it. */
+            (*mainlist)->prev = NULL;
+        }
     }
     else
     {
@@ -10,6 +10,12 @@ struct item
  */
 void movetohead(struct item **mainlist, struct item *item);
 
+/*
+ * Move element next so it comes right after item in list mainlist.
+ */
+void movetonext(struct item **mainlist, struct item *item,
+                struct item *next);
+
 /*
  * Create space for a new item and add it to the head of mainlist.
  *
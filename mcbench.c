@@ -0,0 +1,886 @@
+/*
+ * mcbench - Benchmark mcwm. Maps a number of windows, starts mcwm
+ * and measures how fast it handles them. Prints the results as JSON
+ * on stdout.
+ *
+ * Normally run by scripts/bench with a private Xvfb display. See
+ * "make bench".
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include <xcb/xcb_icccm.h>
+#include <X11/keysym.h>
+
+#include "config.h"
+
+/* Size of our windows. Small enough to put a few thousand on Xvfb. */
+#define WINSIZE 16
+
+/* Give up waiting for mcwm after this many ms. */
+#define TIMEOUT 5000
+
+/* The screen is stable when no events have come for this many ms. */
+#define QUIET 100
+
+/* Result of one kind of measurement, in ms. */
+struct result
+{
+    int samples;
+    double total;
+    double max;
+};
+
+xcb_connection_t *conn;
+xcb_screen_t *screen;
+xcb_window_t *wins;             /* Our windows. */
+int nwins;                      /* Number of windows. */
+pid_t wmpid = -1;               /* mcwm's process ID. */
+int wmerr = -1;                 /* Pipe from mcwm's stderr. */
+unsigned long exposes = 0;      /* Expose events seen. */
+
+static double getmsec(void);
+static void addresult(struct result *res, double ms);
+static void printresult(char *name, struct result *res);
+static xcb_window_t makewin(int num);
+static int waitfor(uint8_t type, xcb_window_t win, int count,
+                   int16_t x, int16_t y);
+static double settle(void);
+static xcb_keycode_t modkeycode(uint16_t mask);
+static xcb_keycode_t keycode(xcb_keysym_t keysym);
+static void fake(uint8_t type, uint8_t detail, int16_t x, int16_t y);
+static double startwm(char *path);
+static bool wmready(void);
+static long wmwrites(void);
+static void stopwm(void);
+static void benchmap(struct result *res, int samples);
+static bool waitswitch(int unmaps, int maps);
+static void wskey(xcb_keycode_t mod, xcb_keycode_t key);
+static void benchworkspace(struct result *done, struct result *stable,
+                           double *exposed, int samples);
+static void benchfocus(struct result *res, int samples);
+static void benchdrag(int motions);
+static void printhelp(void);
+
+/* Get a monotonic time stamp in milliseconds. */
+double getmsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void addresult(struct result *res, double ms)
+{
+    res->samples ++;
+    res->total += ms;
+    if (ms > res->max)
+    {
+        res->max = ms;
+    }
+}
+
+void printresult(char *name, struct result *res)
+{
+    printf("  \"%s\": { \"samples\": %d, \"mean_ms\": %.3f, "
+           "\"max_ms\": %.3f },\n", name, res->samples,
+           0 == res->samples ? 0.0 : res->total / res->samples, res->max);
+}
+
+/*
+ * Create window number num in a grid on the screen and tell the
+ * window manager we want it exactly there.
+ */
+xcb_window_t makewin(int num)
+{
+    xcb_window_t win;
+    xcb_size_hints_t hints;
+    uint32_t values[2];
+    int cols;
+    int16_t x;
+    int16_t y;
+
+    cols = screen->width_in_pixels / (WINSIZE + 4);
+    x = (num % cols) * (WINSIZE + 4);
+    y = ((num / cols) * (WINSIZE + 4)) % (screen->height_in_pixels - WINSIZE);
+
+    values[0] = screen->white_pixel;
+    values[1] = XCB_EVENT_MASK_STRUCTURE_NOTIFY
+        | XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_EXPOSURE;
+
+    win = xcb_generate_id(conn);
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, win, screen->root,
+                      x, y, WINSIZE, WINSIZE, 0,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      screen->root_visual,
+                      XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+
+    memset(&hints, 0, sizeof hints);
+    xcb_icccm_size_hints_set_position(&hints, 1, x, y);
+    xcb_icccm_set_wm_normal_hints(conn, win, &hints);
+
+    return win;
+}
+
+/*
+ * Wait for count events of type on window win, or on any of our
+ * windows if win is XCB_NONE. For ConfigureNotify, wait until win is
+ * at x,y instead.
+ *
+ * Returns number of events seen.
+ */
+int waitfor(uint8_t type, xcb_window_t win, int count, int16_t x, int16_t y)
+{
+    xcb_generic_event_t *ev;
+    struct pollfd pfd;
+    double deadline;
+    int seen = 0;
+    bool done = false;
+
+    pfd.fd = xcb_get_file_descriptor(conn);
+    pfd.events = POLLIN;
+
+    xcb_flush(conn);
+
+    deadline = getmsec() + TIMEOUT;
+
+    while (!done)
+    {
+        ev = xcb_poll_for_event(conn);
+        if (NULL == ev)
+        {
+            if (xcb_connection_has_error(conn))
+            {
+                fprintf(stderr, "mcbench: Lost X connection.\n");
+                stopwm();
+                exit(1);
+            }
+
+            if (getmsec() > deadline)
+            {
+                fprintf(stderr, "mcbench: Timeout waiting for event %d.\n",
+                        type);
+                break;
+            }
+
+            poll(&pfd, 1, 10);
+            continue;
+        }
+
+        if ((ev->response_type & ~0x80) == XCB_EXPOSE)
+        {
+            exposes ++;
+        }
+
+        if ((ev->response_type & ~0x80) == type)
+        {
+            xcb_window_t evwin;
+
+            switch (type)
+            {
+            case XCB_MAP_NOTIFY:
+                evwin = ((xcb_map_notify_event_t *) ev)->window;
+                break;
+
+            case XCB_UNMAP_NOTIFY:
+                evwin = ((xcb_unmap_notify_event_t *) ev)->window;
+                break;
+
+            case XCB_FOCUS_IN:
+                evwin = ((xcb_focus_in_event_t *) ev)->event;
+                break;
+
+            case XCB_CONFIGURE_NOTIFY:
+            {
+                xcb_configure_notify_event_t *e
+                    = (xcb_configure_notify_event_t *) ev;
+
+                evwin = e->window;
+                if (evwin == win && e->x == x && e->y == y)
+                {
+                    done = true;
+                }
+            }
+            break;
+
+            default:
+                evwin = XCB_NONE;
+                break;
+            }
+
+            if (XCB_NONE == win || evwin == win)
+            {
+                seen ++;
+                if (XCB_CONFIGURE_NOTIFY != type && seen == count)
+                {
+                    done = true;
+                }
+            }
+        }
+
+        free(ev);
+    }
+
+    return seen;
+}
+
+/*
+ * Read events until none have come for QUIET ms, counting Expose
+ * events.
+ *
+ * Returns when the last event came, in ms.
+ */
+double settle(void)
+{
+    xcb_generic_event_t *ev;
+    struct pollfd pfd;
+    double last;
+
+    pfd.fd = xcb_get_file_descriptor(conn);
+    pfd.events = POLLIN;
+
+    xcb_flush(conn);
+
+    last = getmsec();
+
+    while (getmsec() - last < QUIET)
+    {
+        ev = xcb_poll_for_event(conn);
+        if (NULL == ev)
+        {
+            poll(&pfd, 1, 10);
+            continue;
+        }
+
+        if ((ev->response_type & ~0x80) == XCB_EXPOSE)
+        {
+            exposes ++;
+        }
+
+        last = getmsec();
+        free(ev);
+    }
+
+    return last;
+}
+
+/* Find a keycode for the modifier mask. */
+xcb_keycode_t modkeycode(uint16_t mask)
+{
+    xcb_get_modifier_mapping_reply_t *reply;
+    xcb_keycode_t *codes;
+    xcb_keycode_t code = 0;
+    int mod;
+    int i;
+
+    reply = xcb_get_modifier_mapping_reply(
+        conn, xcb_get_modifier_mapping_unchecked(conn), NULL);
+    if (NULL == reply)
+    {
+        return 0;
+    }
+
+    codes = xcb_get_modifier_mapping_keycodes(reply);
+
+    /* Modifier masks are 1 << modifier index. */
+    for (mod = 0; mod < 8 && !(mask & (1 << mod)); mod ++)
+        ;
+
+    for (i = 0; i < reply->keycodes_per_modifier && 0 == code; i ++)
+    {
+        code = codes[mod * reply->keycodes_per_modifier + i];
+    }
+
+    free(reply);
+
+    return code;
+}
+
+/* Find a keycode for keysym. Returns 0 if there is none. */
+xcb_keycode_t keycode(xcb_keysym_t keysym)
+{
+    const xcb_setup_t *setup = xcb_get_setup(conn);
+    xcb_get_keyboard_mapping_reply_t *reply;
+    xcb_keysym_t *syms;
+    xcb_keycode_t code = 0;
+    int count;
+    int i;
+
+    reply = xcb_get_keyboard_mapping_reply(
+        conn, xcb_get_keyboard_mapping(conn, setup->min_keycode,
+                                       setup->max_keycode
+                                       - setup->min_keycode + 1), NULL);
+    if (NULL == reply)
+    {
+        return 0;
+    }
+
+    syms = xcb_get_keyboard_mapping_keysyms(reply);
+    count = xcb_get_keyboard_mapping_keysyms_length(reply);
+
+    for (i = 0; i < count; i ++)
+    {
+        if (syms[i] == keysym)
+        {
+            code = setup->min_keycode + i / reply->keysyms_per_keycode;
+            break;
+        }
+    }
+
+    free(reply);
+
+    return code;
+}
+
+/* Fake an input event. */
+void fake(uint8_t type, uint8_t detail, int16_t x, int16_t y)
+{
+    xcb_test_fake_input(conn, type, detail, XCB_CURRENT_TIME, screen->root,
+                        x, y, 0);
+}
+
+/*
+ * Start the window manager in path and wait until it has adopted our
+ * windows.
+ *
+ * Returns the adoption time mcwm reports, in ms, or -1 on failure.
+ */
+double startwm(char *path)
+{
+    int fds[2];
+    FILE *fp;
+    char line[256];
+    unsigned long ms;
+    int adopted;
+    int total;
+
+    if (-1 == pipe(fds))
+    {
+        perror("mcbench: pipe");
+        return -1;
+    }
+
+    wmpid = fork();
+    if (-1 == wmpid)
+    {
+        perror("mcbench: fork");
+        return -1;
+    }
+
+    if (0 == wmpid)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        execl(path, path, (char *) NULL);
+        perror("mcbench: exec");
+        exit(1);
+    }
+
+    close(fds[1]);
+    wmerr = fds[0];
+
+    fp = fdopen(wmerr, "r");
+    if (NULL == fp)
+    {
+        return -1;
+    }
+
+    /* Look for the line setupscreen() prints when it's done. */
+    while (NULL != fgets(line, sizeof line, fp))
+    {
+        if (3 == sscanf(line, "mcwm: Adopted %d of %d windows in %lu ms.",
+                        &adopted, &total, &ms))
+        {
+            return ms;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Check if the window manager has grabbed its mouse buttons on the
+ * root. It does that last before it starts handling events.
+ */
+bool wmready(void)
+{
+    xcb_generic_error_t *error;
+    xcb_void_cookie_t cookie;
+
+    cookie = xcb_grab_button_checked(conn, 0, screen->root,
+                                     XCB_EVENT_MASK_BUTTON_PRESS,
+                                     XCB_GRAB_MODE_ASYNC,
+                                     XCB_GRAB_MODE_ASYNC,
+                                     XCB_NONE, XCB_NONE, 1, MOUSEMODKEY);
+
+    error = xcb_request_check(conn, cookie);
+    if (NULL != error)
+    {
+        /* Somebody else has it. */
+        free(error);
+        return true;
+    }
+
+    xcb_ungrab_button(conn, 1, screen->root, MOUSEMODKEY);
+    return false;
+}
+
+/*
+ * Ask the kernel how many write system calls mcwm has made. Writes to
+ * the X socket are most of them, so this tells us how often it
+ * flushes.
+ *
+ * Returns the number or -1 if we can't tell, for instance when there
+ * is no /proc.
+ */
+long wmwrites(void)
+{
+    char path[64];
+    char line[128];
+    FILE *fp;
+    long writes = -1;
+
+    snprintf(path, sizeof path, "/proc/%d/io", (int) wmpid);
+    fp = fopen(path, "r");
+    if (NULL == fp)
+    {
+        return -1;
+    }
+
+    while (NULL != fgets(line, sizeof line, fp))
+    {
+        if (1 == sscanf(line, "syscw: %ld", &writes))
+        {
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    return writes;
+}
+
+void stopwm(void)
+{
+    char buf[4096];
+
+    if (-1 == wmpid)
+    {
+        return;
+    }
+
+    kill(wmpid, SIGTERM);
+
+    /* Throw away whatever mcwm prints when exiting. */
+    while (0 < read(wmerr, buf, sizeof buf))
+        ;
+
+    waitpid(wmpid, NULL, 0);
+    wmpid = -1;
+}
+
+/* Map new windows and wait until they are mapped. */
+void benchmap(struct result *res, int samples)
+{
+    xcb_window_t win;
+    double start;
+    int i;
+
+    for (i = 0; i < samples; i ++)
+    {
+        win = makewin(nwins + i);
+
+        start = getmsec();
+        xcb_map_window(conn, win);
+        if (1 == waitfor(XCB_MAP_NOTIFY, win, 1, 0, 0))
+        {
+            addresult(res, getmsec() - start);
+        }
+
+        xcb_destroy_window(conn, win);
+    }
+}
+
+/*
+ * Wait until unmaps windows are unmapped and maps windows are mapped.
+ *
+ * Returns true if they were.
+ */
+bool waitswitch(int unmaps, int maps)
+{
+    xcb_generic_event_t *ev;
+    struct pollfd pfd;
+    double deadline;
+
+    pfd.fd = xcb_get_file_descriptor(conn);
+    pfd.events = POLLIN;
+
+    xcb_flush(conn);
+
+    deadline = getmsec() + TIMEOUT;
+
+    while (unmaps > 0 || maps > 0)
+    {
+        ev = xcb_poll_for_event(conn);
+        if (NULL == ev)
+        {
+            if (getmsec() > deadline)
+            {
+                fprintf(stderr, "mcbench: Timeout changing workspace.\n");
+                return false;
+            }
+
+            poll(&pfd, 1, 10);
+            continue;
+        }
+
+        switch (ev->response_type & ~0x80)
+        {
+        case XCB_EXPOSE:
+            exposes ++;
+            break;
+
+        case XCB_UNMAP_NOTIFY:
+            unmaps --;
+            break;
+
+        case XCB_MAP_NOTIFY:
+            maps --;
+            break;
+        }
+
+        free(ev);
+    }
+
+    return true;
+}
+
+/* Press MODKEY + key. */
+void wskey(xcb_keycode_t mod, xcb_keycode_t key)
+{
+    fake(XCB_KEY_PRESS, mod, 0, 0);
+    fake(XCB_KEY_PRESS, key, 0, 0);
+    fake(XCB_KEY_RELEASE, key, 0, 0);
+    fake(XCB_KEY_RELEASE, mod, 0, 0);
+}
+
+/*
+ * Switch back and forth between workspace 1, with the even windows,
+ * and workspace 2, with the odd windows. Measure until all windows
+ * are mapped or unmapped, then until no more events come. Count
+ * Expose events.
+ */
+void benchworkspace(struct result *done, struct result *stable,
+                    double *exposed, int samples)
+{
+    xcb_keycode_t mod;
+    xcb_keycode_t keys[2];
+    int counts[2];
+    double start;
+    unsigned long before;
+    int i;
+
+    mod = modkeycode(MODKEY);
+    keys[0] = keycode(USERKEY_WS1);
+    keys[1] = keycode(USERKEY_WS2);
+    if (0 == mod || 0 == keys[0] || 0 == keys[1])
+    {
+        fprintf(stderr, "mcbench: Can't find workspace keys.\n");
+        return;
+    }
+
+    counts[0] = (nwins + 1) / 2;
+    counts[1] = nwins / 2;
+
+    /* Forget everything that happened before. */
+    settle();
+    before = exposes;
+
+    for (i = 0; i < samples * 2; i ++)
+    {
+        /* Odd switches go to workspace 2, even back to 1. */
+        int to = (i + 1) % 2;
+
+        start = getmsec();
+        wskey(mod, keys[to]);
+        if (waitswitch(counts[1 - to], counts[to]))
+        {
+            addresult(done, getmsec() - start);
+            addresult(stable, settle() - start);
+        }
+    }
+
+    *exposed = (double) (exposes - before) / (samples * 2);
+}
+
+/*
+ * Move the pointer into a window and wait until it gets focus. mcwm
+ * has sloppy focus. Needs at least two windows on the workspace so
+ * focus always changes.
+ */
+void benchfocus(struct result *res, int samples)
+{
+    xcb_get_geometry_reply_t *geom;
+    xcb_window_t win;
+    double start;
+    int i;
+
+    for (i = 0; i < samples; i ++)
+    {
+        /* Only the even windows are on the current workspace. */
+        win = wins[2 * ((i * 7919) % ((nwins + 1) / 2))];
+
+        geom = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, win),
+                                      NULL);
+        if (NULL == geom)
+        {
+            continue;
+        }
+
+        start = getmsec();
+        xcb_warp_pointer(conn, XCB_NONE, screen->root, 0, 0, 0, 0,
+                         geom->x + WINSIZE / 2, geom->y + WINSIZE / 2);
+        if (1 == waitfor(XCB_FOCUS_IN, win, 1, 0, 0))
+        {
+            addresult(res, getmsec() - start);
+        }
+
+        free(geom);
+    }
+}
+
+/*
+ * Drag a window with the mouse one pixel at a time and count how
+ * many times mcwm actually moved it.
+ */
+void benchdrag(int motions)
+{
+    xcb_get_geometry_reply_t *geom;
+    xcb_keycode_t mod;
+    xcb_window_t win = wins[0];
+    int16_t x;
+    int16_t y;
+    double start;
+    double ms;
+    int updates;
+    int i;
+
+    mod = modkeycode(MOUSEMODKEY);
+    geom = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, win), NULL);
+    if (0 == mod || NULL == geom)
+    {
+        fprintf(stderr, "mcbench: Can't drag.\n");
+        free(geom);
+        return;
+    }
+
+    x = geom->x + WINSIZE / 2;
+    y = geom->y + WINSIZE / 2;
+
+    fake(XCB_MOTION_NOTIFY, 0, x, y);
+    fake(XCB_KEY_PRESS, mod, 0, 0);
+    fake(XCB_BUTTON_PRESS, 1, 0, 0);
+    xcb_flush(conn);
+
+    start = getmsec();
+    for (i = 1; i <= motions; i ++)
+    {
+        fake(XCB_MOTION_NOTIFY, 0, x + i % 256, y + i / 256);
+        xcb_flush(conn);
+    }
+    fake(XCB_BUTTON_RELEASE, 1, 0, 0);
+    fake(XCB_KEY_RELEASE, mod, 0, 0);
+
+    /* Wait until the window ends up where we left it. */
+    updates = waitfor(XCB_CONFIGURE_NOTIFY, win, 0,
+                      geom->x + (motions % 256), geom->y + motions / 256);
+    ms = getmsec() - start;
+
+    printf("  \"drag\": { \"motions\": %d, \"updates\": %d, \"ms\": %.3f, "
+           "\"updates_per_sec\": %.1f },\n", motions, updates, ms,
+           ms > 0 ? updates * 1000.0 / ms : 0.0);
+
+    free(geom);
+}
+
+void printhelp(void)
+{
+    printf("mcbench: Usage: mcbench [-n windows] [-s samples] "
+           "[-w mcwm-program]\n");
+    printf("  -n windows to map before starting mcwm\n");
+    printf("  -s samples to take of every measurement\n");
+    printf("  -w mcwm-program is the window manager to run, default "
+           "./mcwm\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct result map = { 0, 0, 0 };
+    struct result wsdone = { 0, 0, 0 };
+    struct result wsstable = { 0, 0, 0 };
+    double wsexposed = 0;
+    xcb_intern_atom_reply_t *atom;
+    uint32_t ws = 1;
+    struct result focus = { 0, 0, 0 };
+    char *wmpath = "./mcwm";
+    int samples = 100;
+    double adopt;
+    long writes;
+    long after;
+    int ch;
+    int i;
+
+    nwins = 100;
+
+    while (1)
+    {
+        ch = getopt(argc, argv, "hn:s:w:");
+        if (-1 == ch)
+        {
+            break;
+        }
+
+        switch (ch)
+        {
+        case 'n':
+            nwins = atoi(optarg);
+            break;
+
+        case 's':
+            samples = atoi(optarg);
+            break;
+
+        case 'w':
+            wmpath = optarg;
+            break;
+
+        case 'h':
+        default:
+            printhelp();
+            exit(0);
+        }
+    }
+
+    if (nwins < 1 || samples < 1)
+    {
+        printhelp();
+        exit(1);
+    }
+
+    conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn))
+    {
+        fprintf(stderr, "mcbench: Can't open display.\n");
+        exit(1);
+    }
+
+    screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+
+    wins = calloc(nwins, sizeof (xcb_window_t));
+    if (NULL == wins)
+    {
+        fprintf(stderr, "mcbench: Out of memory.\n");
+        exit(1);
+    }
+
+    atom = xcb_intern_atom_reply(
+        conn, xcb_intern_atom(conn, 0, strlen("_NET_WM_DESKTOP"),
+                              "_NET_WM_DESKTOP"), NULL);
+    if (NULL == atom)
+    {
+        fprintf(stderr, "mcbench: Can't get atom.\n");
+        exit(1);
+    }
+
+    /*
+     * Map all windows before the window manager starts. Every other
+     * window goes on the second workspace.
+     */
+    for (i = 0; i < nwins; i ++)
+    {
+        wins[i] = makewin(i);
+        if (1 == i % 2)
+        {
+            xcb_change_property(conn, XCB_PROP_MODE_REPLACE, wins[i],
+                                atom->atom, XCB_ATOM_CARDINAL, 32, 1, &ws);
+        }
+        xcb_map_window(conn, wins[i]);
+    }
+    free(atom);
+    waitfor(XCB_MAP_NOTIFY, XCB_NONE, nwins, 0, 0);
+
+    adopt = startwm(wmpath);
+    if (adopt < 0)
+    {
+        fprintf(stderr, "mcbench: mcwm didn't start.\n");
+        stopwm();
+        exit(1);
+    }
+
+    while (!wmready())
+    {
+        usleep(1000);
+    }
+
+    writes = wmwrites();
+
+    benchmap(&map, samples);
+    benchworkspace(&wsdone, &wsstable, &wsexposed,
+                   samples < 10 ? samples : 10);
+    if (nwins > 3)
+    {
+        benchfocus(&focus, samples);
+    }
+
+    printf("{\n");
+    printf("  \"windows\": %d,\n", nwins);
+    printf("  \"adopt_ms\": %.0f,\n", adopt);
+    printresult("map", &map);
+    printresult("workspace_switch", &wsdone);
+    printresult("workspace_stable", &wsstable);
+    printf("  \"workspace_exposes\": %.1f,\n", wsexposed);
+    printresult("focus", &focus);
+    benchdrag(samples * 10);
+
+    /* Everything mcwm wrote while we measured. */
+    after = wmwrites();
+    if (-1 != writes && -1 != after)
+    {
+        printf("  \"write_syscalls\": %ld,\n", after - writes);
+    }
+    printf("  \"ok\": true\n");
+    printf("}\n");
+
+    stopwm();
+    xcb_disconnect(conn);
+
+    exit(0);
+}
@@ -33,13 +33,23 @@
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#else
 #include <sys/select.h>
+#endif
 
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include <xcb/randr.h>
+#include <xcb/xinerama.h>
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xcb_atom.h>
 #include <xcb/xcb_icccm.h>
@@ -49,11 +59,12 @@
 #include <xcb/xproto.h>
 #include <xcb/xcb_util.h>
 
-#ifdef DEBUG
 #include "events.h"
-#endif
 
 #include "list.h"
+#include "hash.h"
+#include "edges.h"
+#include "place.h"
 
 /* Check here for user configurable parts: */
 #include "config.h"
@@ -86,8 +97,26 @@
  */
 #define MCWM_TABBING 4
 
-/* Number of workspaces. */
-#define WORKSPACES 10
+/* Length of a tick in the timer wheel, in ms. */
+#define TIMER_TICK 10
+
+/* Number of slots in the timer wheel. */
+#define TIMER_SLOTS 64
+
+/* Max number of file descriptors we wait for in the event loop. */
+#define MAXSOURCES 8
+
+/*
+ * Event statistics. Handling times go in buckets by powers of two
+ * microseconds: bucket 0 is less than 1 us, bucket n is less than
+ * 2^n us. The last bucket takes everything slower.
+ */
+#define STATBUCKETS 16
+
+/* Statistics slots for events not in events.h. */
+#define STAT_RANDR (MAXEVENTS + 1)
+#define STAT_OTHER (MAXEVENTS + 2)
+#define STATTYPES (MAXEVENTS + 3)
 
 /* Value in WM hint which means this window is fixed on all workspaces. */
 #define NET_WM_FIXED 0xffffffff
@@ -95,6 +124,13 @@
 /* This means we didn't get any window hint at all. */
 #define MCWM_NOWS 0xfffffffe
 
+/* Format of the _MCWM_STATE property. Change if struct winstate changes. */
+#define STATE_VERSION 1
+
+/* Flags in struct winstate. */
+#define STATE_MAXED 1
+#define STATE_VERTMAXED 2
+
 
 /* Types. */
 
@@ -134,15 +170,61 @@ typedef enum {
     KEY_MAX
 } key_enum_t;
 
+/* Free space left on a workspace for new windows. See place.c. */
+struct wsspace
+{
+    struct freespace free;
+    bool stale;                 /* Lost track, for instance when a fixed
+                                 * window moved. Rebuild before using. */
+};
+
+/*
+ * A set of workspaces. Every monitor has its own. Windows that aren't
+ * on any monitor use rootws.
+ */
+struct wsset
+{
+    uint32_t curws;             /* Current workspace. */
+    struct item **wslist;       /* Window list of every workspace,
+                                 * conf.workspaces of them. Fixed windows
+                                 * aren't on these lists. */
+    struct item *fixedlist;     /* Fixed windows. They are visible on all
+                                 * workspaces, so they're kept here
+                                 * instead of on every workspace list. */
+    struct item *clients;       /* All windows using this set. */
+    struct wsspace *space;      /* Free space on every workspace. */
+    struct area *others;        /* Where the other windows are when we
+                                 * give back space. Kept between uses. */
+    uint32_t otherssize;        /* Room in others. */
+};
+
 struct monitor
 {
-    xcb_randr_output_t id;
+    xcb_randr_output_t id;      /* Output, RANDR 1.5 monitor name atom or
+                                 * Xinerama screen number. */
     char *name;
     int16_t x;                 /* X and Y. */
     int16_t y;
     uint16_t width;     /* Width in pixels. */
     uint16_t height;    /* Height in pixels. */
     struct item *item; /* Pointer to our place in output list. */
+    struct wsset wsset;         /* Workspaces on this monitor. */
+};
+
+/*
+ * A monitor as RANDR or Xinerama reports it, before we make it one of ours. See
+ * updatemonitors().
+ */
+struct head
+{
+    xcb_randr_output_t id;      /* Output, RANDR 1.5 monitor name atom or
+                                 * Xinerama screen number. */
+    char *name;                 /* Name, not null terminated. */
+    int namelen;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
 };
 
 struct sizepos
@@ -170,10 +252,67 @@ struct client
     bool vertmaxed;             /* Vertically maximized? */
     bool maxed;                 /* Totally maximized? */
     bool fixed;           /* Visible on all workspaces? */
+    uint32_t ws;                /* Workspace we're on if not fixed. */
     struct monitor *monitor;    /* The physical output this window is on. */
+    struct item *monitem;       /* Our place in our wsset's client list. */
     struct item *winitem; /* Pointer to our place in global windows list. */
-    struct item *wsitem[WORKSPACES]; /* Pointer to our place in every
-                                             * workspace window list. */
+    struct item *wsitem;        /* Pointer to our place in our workspace
+                                 * window list or in fixedlist. NULL if
+                                 * on no workspace. */
+    int unmaps;                 /* Number of UnmapNotify we caused and
+                                 * haven't seen yet. */
+    uint32_t desktop;           /* _NET_WM_DESKTOP as last written or read.
+                                 * MCWM_NOWS if unknown. */
+    uint32_t newdesktop;        /* _NET_WM_DESKTOP to write. */
+    struct sizepos placed;      /* Where our workspace's free space
+                                 * thinks we are. */
+    struct item *dirtyitem;     /* Our place in dirtylist or NULL. */
+};
+
+/*
+ * Cookies for everything we want to know about an already existing
+ * window when we adopt it at startup.
+ */
+struct adoptcookies
+{
+    xcb_get_window_attributes_cookie_t attr;
+    xcb_get_geometry_cookie_t geom;
+    xcb_get_property_cookie_t hints;
+    xcb_get_property_cookie_t desktop; /* Only asked if state is NULL. */
+    struct winstate *state;     /* What _MCWM_STATE says or NULL. */
+};
+
+/*
+ * What we remember about a window in the _MCWM_STATE property on the
+ * root so a restarted mcwm can find everything in one request. The
+ * property is a version number followed by one of these per window,
+ * all as 32 bit CARDINALs.
+ */
+struct winstate
+{
+    uint32_t id;                /* Window ID. */
+    uint32_t ws;                /* Workspace or NET_WM_FIXED. */
+    uint32_t flags;             /* STATE_MAXED, STATE_VERTMAXED. */
+    int32_t x;                  /* Original size if maxed. */
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+/* A function to call later. See settimer(). */
+struct timer
+{
+    uint64_t expire;            /* When to call, in ms. */
+    void (*func)(void);         /* What to call. */
+    struct item *item;          /* Our place in the timer wheel or NULL
+                                 * if not set. */
+};
+
+/* A file descriptor we wait for in the event loop. See addsource(). */
+struct source
+{
+    int fd;
+    void (*func)(int fd);       /* Called when fd is readable. */
 };
 
 /* Window configuration data. */
@@ -188,6 +327,13 @@ struct winconf
     uint16_t     borderwidth;
 };
 
+/* A colour we want and where to store its pixel value. */
+struct colordef
+{
+    const char *name;           /* Colour name or #rrggbb. */
+    uint32_t *pixel;
+};
+
 
 /* Globals */
 
@@ -196,34 +342,149 @@ int sigcode;                    /* Signal code. Non-zero if we've been
 xcb_connection_t *conn;         /* Connection to X server. */
 xcb_screen_t *screen;           /* Our current screen.  */
 int randrbase;                  /* Beginning of RANDR extension events. */
-uint32_t curws = 0;             /* Current workspace. */
+bool randroutputs = false;      /* RANDR 1.3 outputs and CRTCs
+                                 * available? */
+bool randrmonitors = false;     /* RANDR 1.5 monitors available? */
+bool xinerama = false;          /* Monitors from Xinerama instead of
+                                 * RANDR? */
+struct monitor *curmon = NULL;  /* Monitor we work on. NULL if none. */
 struct client *focuswin;        /* Current focus window. */
 struct client *lastfocuswin;        /* Last focused window. NOTE! Only
                                      * used to communicate between
                                      * start and end of tabbing
                                      * mode. */
 struct item *winlist = NULL;    /* Global list of all client windows. */
+struct hashtab clienttab;       /* All clients, indexed by window ID. */
+
+/*
+ * Stacking order of all children of the root, top first, as the
+ * notify events tell us. Only used to skip restacking windows that
+ * are already where we want them, so it doesn't matter much if it's
+ * briefly wrong.
+ */
+struct item *stacklist = NULL;
+struct hashtab stacktab;        /* Items in stacklist by window ID. */
 struct item *monlist = NULL;    /* List of all physical monitor outputs. */
-int mode = 0;                   /* Internal mode, such as move or resize */
 
 /*
- * Workspace list: Every workspace has a list of all visible
- * windows.
+ * Where all monitors in monlist are, in the same order, kept in one
+ * array so we don't have to walk the list to find out which monitor a
+ * point is on. Rebuilt by buildmontab() when monitors change.
  */
-struct item *wslist[WORKSPACES] =
+struct monrect
 {
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    xcb_randr_output_t id;
+    struct monitor *mon;
 };
 
+struct
+{
+    struct monrect *rects;
+    int num;                    /* Number of monitors. */
+    int size;                   /* Room for this many. */
+    int last;                   /* Where findmonbycoord() last found one. */
+} montab;
+int mode = 0;                   /* Internal mode, such as move or resize */
+
+/*
+ * Events read from the X server but not yet handled. We read all
+ * waiting events at once so we can throw away those made redundant
+ * by later events before handling them.
+ */
+struct evbuf
+{
+    xcb_generic_event_t **evs;
+    int len;                    /* Number of events in buffer. */
+    int next;                   /* Next event to handle. */
+    int size;                   /* Allocated size. */
+    struct hashtab configs;     /* Latest ConfigureRequest per window. */
+    unsigned long received;     /* Total number of events read. */
+    unsigned long dropped;      /* Total number of events thrown away. */
+} evbuf;
+
+/*
+ * Timer wheel. Every slot has a list of timers expiring in a tick
+ * that maps to this slot. A slot might hold timers expiring several
+ * turns of the wheel ahead.
+ */
+struct item *wheel[TIMER_SLOTS];
+uint64_t lasttick;              /* Last tick we ran timers for. */
+int ntimers = 0;                /* Number of timers set. */
+
+/* Rescans monitors when screen changes have settled. */
+struct timer settletimer;
+
+/* Statistics for every type of event we handle. */
+struct evstat
+{
+    unsigned long count;        /* Number of events handled. */
+    unsigned long roundtrips;   /* Replies we waited for handling them. */
+    uint64_t total;             /* Total time spent, in us. */
+    uint64_t max;               /* Slowest, in us. */
+    unsigned long hist[STATBUCKETS]; /* Handling times. */
+} evstats[STATTYPES];
+
+unsigned long roundtrips = 0;   /* Number of times we waited for replies.
+                                 * Only waitreply() and checkrequest()
+                                 * count them. */
+unsigned long restacks = 0;     /* Restack requests sent. */
+unsigned long norestacks = 0;   /* Restacks skipped, nothing would change. */
+unsigned long rescans = 0;      /* Monitor rescans after screen changes. */
+unsigned long norescans = 0;    /* Rescans skipped, another change came. */
+int wantstats = 0;              /* Non-zero if asked to dump statistics. */
+
+/* Everything we wait for in the event loop. */
+struct source sources[MAXSOURCES];
+int nsources = 0;
+
+#ifdef __linux__
+int epfd = -1;                  /* epoll descriptor. */
+int sigfd = -1;                 /* signalfd for the signals we handle. */
+int timerfd = -1;               /* timerfd for the timer wheel. */
+uint64_t timerarmed = 0;        /* When timerfd will fire, in ms. 0 if
+                                 * not armed. */
+#endif
+
+/* State of the current move or resize with the mouse. */
+struct drag
+{
+    int16_t x;                  /* Latest pointer root coordinates. */
+    int16_t y;
+    bool pending;               /* Pointer moved but window not updated. */
+    uint64_t last;              /* When we last updated, in ms. */
+    struct timer timer;         /* Does a skipped update if the pointer
+                                 * stops moving. */
+} drag;
+
+/*
+ * Edges of the other windows in the window ring, collected when a
+ * drag starts so snapwindow() doesn't have to look at all of them on
+ * every motion.
+ */
+struct
+{
+    struct edgeindex right;     /* Right edges, for our left edge. */
+    struct edgeindex bottom;    /* Bottom edges, for our top edge. */
+    struct edgeindex left;      /* Left edges, for our right edge. */
+    struct edgeindex top;       /* Top edges, for our bottom edge. */
+} snap;
+
+/* Workspaces of windows on no monitor, for instance without RANDR. */
+struct wsset rootws;
+
+/*
+ * Clients with a _NET_WM_DESKTOP to write. Written by
+ * flushdesktops() before we flush requests to the server.
+ */
+struct item *dirtylist = NULL;
+
+/* Something in _MCWM_STATE changed. Written by writestate(). */
+bool statedirty = false;
+
 /* Shortcut key type and initializiation. */
 struct keys
 {
@@ -280,11 +541,17 @@ struct conf
 {
     int borderwidth;            /* Do we draw borders? If so, how large? */
     int snapmargin;             /* Do we have snap margin? If so, how large? */
+    int dragrate;               /* Max window updates per second when
+                                 * dragging. 0 means no limit. */
     char *terminal;             /* Path to terminal to start. */
     uint32_t focuscol;          /* Focused border colour. */
     uint32_t unfocuscol;        /* Unfocused border colour.  */
     uint32_t fixedcol;          /* Fixed windows border colour. */
     bool allowicons;            /* Allow windows to be unmapped. */
+    uint32_t workspaces;        /* Number of workspaces. */
+    bool atomicswitch;          /* Grab server when changing workspace. */
+    uint32_t settle;            /* Wait this many ms after the last screen
+                                 * change before rescanning monitors. */
 } conf;
 
 xcb_atom_t atom_desktop;        /*
@@ -293,11 +560,33 @@ xcb_atom_t atom_desktop;        /*
                                  * on.
                                  */
 
+xcb_atom_t atom_numdesktops;    /* EWMH _NET_NUMBER_OF_DESKTOPS. */
+xcb_atom_t atom_state;          /* Our own _MCWM_STATE. */
+
 xcb_atom_t wm_delete_window;    /* WM_DELETE_WINDOW event to close windows.  */
 xcb_atom_t wm_change_state;
 xcb_atom_t wm_state;
 xcb_atom_t wm_protocols;        /* WM_PROTOCOLS.  */
 
+/*
+ * All atoms we use. To use another atom, add it here and it will be
+ * interned with all the others at startup.
+ */
+struct atomdef
+{
+    char *name;
+    xcb_atom_t *atom;
+} atomdefs[] =
+{
+    { "_NET_WM_DESKTOP", &atom_desktop },
+    { "_NET_NUMBER_OF_DESKTOPS", &atom_numdesktops },
+    { "_MCWM_STATE", &atom_state },
+    { "WM_DELETE_WINDOW", &wm_delete_window },
+    { "WM_CHANGE_STATE", &wm_change_state },
+    { "WM_STATE", &wm_state },
+    { "WM_PROTOCOLS", &wm_protocols }
+};
+
 
 /* Functions declerations. */
 
@@ -305,34 +594,80 @@ static void finishtabbing(void);
 static struct modkeycodes getmodkeys(xcb_mod_mask_t modmask);
 static void cleanup(int code);
 static void arrangewindows(void);
-static void setwmdesktop(xcb_drawable_t win, uint32_t ws);
-static int32_t getwmdesktop(xcb_drawable_t win);
+static void setwmdesktop(struct client *client, uint32_t ws);
+static void flushdesktops(void);
+static void writestate(void);
+static int readstate(xcb_get_property_cookie_t cookie, struct hashtab *tab,
+                     xcb_get_property_reply_t **reply);
+static void restorestate(struct client *client, struct winstate *state);
+static xcb_get_property_cookie_t getwmdesktopcookie(xcb_drawable_t win);
+static int32_t getwmdesktop(xcb_drawable_t win,
+                            xcb_get_property_cookie_t cookie);
+static int initwsset(struct wsset *set);
+static void freewsset(struct wsset *set);
+static void monarea(struct monitor *mon, struct area *area);
+static void clientarea(struct client *client, struct area *area);
+static void placedarea(struct client *client, struct area *area);
+static void stalespace(struct wsset *set);
+static void givespace(struct client *client);
+static void usespace(struct client *client);
+static bool placewindow(struct client *client);
+static struct wsset *wssetof(struct monitor *mon);
+static struct wsset *curset(void);
+static void setmonitor(struct client *client, struct monitor *mon);
+static struct item **wslistof(struct client *client);
+static bool onworkspace(struct client *client);
+static struct item *ringfirst(void);
+static struct item *ringlast(void);
+static struct item *ringnext(struct item *item);
+static struct item *ringprev(struct item *item);
+static void unmapwin(struct client *client);
 static void addtoworkspace(struct client *client, uint32_t ws);
-static void delfromworkspace(struct client *client, uint32_t ws);
+static void delfromworkspace(struct client *client);
 static void changeworkspace(uint32_t ws);
 static void fixwindow(struct client *client, bool setcolour);
-static uint32_t getcolor(const char *colstr);
+static xcb_visualtype_t *getvisual(xcb_visualid_t id);
+static bool parsehex(const char *colstr, uint8_t rgb[3]);
+static uint32_t maskpixel(uint8_t value, uint32_t mask);
+static void getcolors(struct colordef *cols, int num);
 static void forgetclient(struct client *client);
 static void forgetwin(xcb_window_t win);
 static void fitonscreen(struct client *client);
 static void newwin(xcb_window_t win);
-static struct client *setupwin(xcb_window_t win);
+static struct client *setupwin(xcb_window_t win,
+                               xcb_get_geometry_cookie_t geomcookie,
+                               xcb_get_property_cookie_t hintscookie);
 static xcb_keycode_t keysymtokeycode(xcb_keysym_t keysym,
                                      xcb_key_symbols_t *keysyms);
 static int setupkeys(void);
 static int setupscreen(void);
 static int setuprandr(void);
 static void getrandr(void);
+static void screenchanged(void);
+static void screensettled(void);
 static void getoutputs(xcb_randr_output_t *outputs, int len,
                        xcb_timestamp_t timestamp);
+static int getmonitors(void);
+static void usemonitors(xcb_randr_get_monitors_reply_t *reply);
+static int findhead(struct monitor *mon, struct monitor **known,
+                    const bool *used, int num);
+static void updatemonitors(struct head *heads, int num);
+static bool setupxinerama(void);
+static void getxinerama(void);
+static void usexinerama(xcb_xinerama_query_screens_reply_t *reply);
 void arrbymon(struct monitor *monitor);
+static void buildmontab(void);
 static struct monitor *findmonitor(xcb_randr_output_t id);
-static struct monitor *findclones(xcb_randr_output_t id, int16_t x, int16_t y);
 static struct monitor *findmonbycoord(int16_t x, int16_t y);
 static void delmonitor(struct monitor *mon);
 static struct monitor *addmonitor(xcb_randr_output_t id, char *name,
                                   uint32_t x, uint32_t y, uint16_t width,
                                   uint16_t height);
+static void initstack(void);
+static void stackadd(xcb_window_t win);
+static void stackdel(xcb_window_t win);
+static void stackabove(xcb_window_t win, xcb_window_t sibling);
+static bool ontop(xcb_window_t win);
 static void raisewindow(xcb_drawable_t win);
 static void raiseorlower(struct client *client);
 static void movelim(struct client *client);
@@ -347,9 +682,12 @@ static void moveresize(xcb_drawable_t win, uint16_t x, uint16_t y,
                        uint16_t width, uint16_t height);
 static void resize(xcb_drawable_t win, uint16_t width, uint16_t height);
 static void resizestep(struct client *client, char direction);
+static void buildsnap(struct client *client);
 static void snapwindow(struct client *client, int snap_mode);
 static void mousemove(struct client *client, int rel_x, int rel_y);
 static void mouseresize(struct client *client, int rel_x, int rel_y);
+static void dragupdate(struct client *client, bool force);
+static void dragflush(void);
 static void movestep(struct client *client, char direction);
 static void setborders(struct client *client, int width);
 static void unmax(struct client *client);
@@ -357,8 +695,8 @@ static void maximize(struct client *client);
 static void maxvert(struct client *client);
 static void hide(struct client *client);
 static bool getpointer(xcb_drawable_t win, int16_t *x, int16_t *y);
-static bool getgeom(xcb_drawable_t win, int16_t *x, int16_t *y, uint16_t *width,
-                    uint16_t *height);
+static bool getgeom(xcb_get_geometry_cookie_t cookie, int16_t *x, int16_t *y,
+                    uint16_t *width, uint16_t *height);
 static void topleft(void);
 static void topright(void);
 static void botleft(void);
@@ -369,10 +707,36 @@ static void nextscreen(void);
 static void handle_keypress(xcb_key_press_event_t *ev);
 static void configwin(xcb_window_t win, uint16_t mask, struct winconf wc);
 static void configurerequest(xcb_configure_request_event_t *e);
+static void mergeconfig(xcb_configure_request_event_t *later,
+                        const xcb_configure_request_event_t *earlier);
+static void coalesce(void);
+static void bufferevents(xcb_generic_event_t *ev);
+static xcb_generic_event_t *getevent(void);
+static void settimer(struct timer *timer, uint32_t msec);
+static void deltimer(struct timer *timer);
+static void runtimers(void);
+static uint64_t nexttimer(void);
+static int addsource(int fd, void (*func)(int fd));
+static void readxcb(int fd);
+#ifdef __linux__
+static void readsignals(int fd);
+static void readtimer(int fd);
+#endif
+static int setupevents(void);
+static void waitevents(void);
+static int statindex(uint8_t type);
+static void statevent(int type, uint64_t start, unsigned long trips);
+static void dumpstats(void);
 static void events(void);
 static void printhelp(void);
+static uint64_t getmsec(void);
+static uint64_t getusec(void);
+static void *waitreply(unsigned int sequence, xcb_generic_error_t **error);
+static xcb_generic_error_t *checkrequest(xcb_void_cookie_t cookie);
+#ifndef __linux__
 static void sigcatch(int sig);
-static xcb_atom_t getatom(char *atom_name);
+#endif
+static void getatoms(void);
 
 
 /* Function bodies. */
@@ -394,11 +758,11 @@ void finishtabbing(void)
 
     if (NULL != lastfocuswin)
     {
-        movetohead(&wslist[curws], lastfocuswin->wsitem[curws]);
+        movetohead(wslistof(lastfocuswin), lastfocuswin->wsitem);
         lastfocuswin = NULL;
     }
 
-    movetohead(&wslist[curws], focuswin->wsitem[curws]);
+    movetohead(wslistof(focuswin), focuswin->wsitem);
 }
 
 /*
@@ -427,7 +791,7 @@ struct modkeycodes getmodkeys(xcb_mod_mask_t modmask)
 
     cookie = xcb_get_modifier_mapping_unchecked(conn);
 
-    if ((reply = xcb_get_modifier_mapping_reply(conn, cookie, NULL)) == NULL)
+    if ((reply = waitreply(cookie.sequence, NULL)) == NULL)
     {
         return keycodes;
     }
@@ -487,6 +851,15 @@ struct modkeycodes getmodkeys(xcb_mod_mask_t modmask)
  */
 void cleanup(int code)
 {
+    dumpstats();
+
+    fprintf(stderr, "mcwm: Read %lu events, threw away %lu redundant.\n",
+            evbuf.received, evbuf.dropped);
+
+    /* Leave workspace hints behind for the next window manager. */
+    flushdesktops();
+    writestate();
+
     xcb_set_input_focus(conn, XCB_NONE,
                         XCB_INPUT_FOCUS_POINTER_ROOT,
                         XCB_CURRENT_TIME);
@@ -514,1359 +887,1211 @@ void arrangewindows(void)
     }
 }
 
-/* Set the EWMH hint that window win belongs on workspace ws. */
-void setwmdesktop(xcb_drawable_t win, uint32_t ws)
-{
-    PDEBUG("Changing _NET_WM_DESKTOP on window %d to %d\n", win, ws);
-
-    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win,
-                        atom_desktop, XCB_ATOM_CARDINAL, 32, 1,
-                        &ws);
-}
-
 /*
- * Get EWWM hint so we might know what workspace window win should be
- * visible on.
- *
- * Returns either workspace, NET_WM_FIXED if this window should be
- * visible on all workspaces or MCWM_NOWS if we didn't find any hints.
+ * Set the EWMH hint that client belongs on workspace ws. The hint is
+ * written later by flushdesktops().
  */
-int32_t getwmdesktop(xcb_drawable_t win)
+void setwmdesktop(struct client *client, uint32_t ws)
 {
-    xcb_get_property_reply_t *reply;
-    xcb_get_property_cookie_t cookie;
-    uint32_t *wsp;
-    uint32_t ws;
+    struct item *item;
 
-    cookie = xcb_get_property(conn, false, win, atom_desktop,
-                              XCB_GET_PROPERTY_TYPE_ANY, 0,
-                              sizeof (int32_t));
+    client->newdesktop = ws;
+    statedirty = true;
 
-    reply = xcb_get_property_reply(conn, cookie, NULL);
-    if (NULL == reply)
+    if (NULL != client->dirtyitem)
     {
-        fprintf(stderr, "mcwm: Couldn't get properties for win %d\n", win);
-        return MCWM_NOWS;
+        return;
     }
 
-    /* Length is 0 if we didn't find it. */
-    if (0 == xcb_get_property_value_length(reply))
+    item = additem(&dirtylist);
+    if (NULL == item)
     {
-        PDEBUG("_NET_WM_DESKTOP reply was 0 length.\n");
-        goto bad;
+        PDEBUG("setwmdesktop: Out of memory. Writing now.\n");
+        client->desktop = ws;
+        xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
+                            atom_desktop, XCB_ATOM_CARDINAL, 32, 1,
+                            &ws);
+        return;
     }
 
-    wsp = xcb_get_property_value(reply);
-
-    ws = *wsp;
-
-    PDEBUG("got _NET_WM_DESKTOP: %d stored at %p.\n", ws, (void *)wsp);
-
-    free(reply);
-
-    return ws;
-
-bad:
-    free(reply);
-    return MCWM_NOWS;
+    item->data = client;
+    client->dirtyitem = item;
 }
 
-/* Add a window, specified by client, to workspace ws. */
-void addtoworkspace(struct client *client, uint32_t ws)
+/*
+ * Write _NET_WM_DESKTOP on all windows in dirtylist, but only where
+ * it actually changed since we last wrote or read it.
+ */
+void flushdesktops(void)
 {
-    struct item *item;
+    struct client *client;
 
-    item = additem(&wslist[ws]);
-    if (NULL == item)
+    while (NULL != dirtylist)
     {
-        PDEBUG("addtoworkspace: Out of memory.\n");
-        return;
-    }
+        client = dirtylist->data;
 
-    /* Remember our place in the workspace window list. */
-    client->wsitem[ws] = item;
+        if (client->newdesktop != client->desktop)
+        {
+            PDEBUG("Changing _NET_WM_DESKTOP on window %d to %d\n",
+                   client->id, client->newdesktop);
 
-    /* Remember the data. */
-    item->data = client;
+            client->desktop = client->newdesktop;
+            xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
+                                atom_desktop, XCB_ATOM_CARDINAL, 32, 1,
+                                &client->desktop);
+        }
 
-    /*
-     * Set window hint property so we can survive a crash.
-     *
-     * Fixed windows have their own special WM hint. We don't want to
-     * mess with that.
-     */
-    if (!client->fixed)
-    {
-        setwmdesktop(client->id, ws);
+        client->dirtyitem = NULL;
+        delitem(&dirtylist, dirtylist);
     }
 }
 
-/* Delete window client from workspace ws. */
-void delfromworkspace(struct client *client, uint32_t ws)
-{
-    delitem(&wslist[ws], client->wsitem[ws]);
-
-    /* Reset our place in the workspace window list. */
-    client->wsitem[ws] = NULL;
-}
-
-/* Change current workspace to ws. */
-void changeworkspace(uint32_t ws)
+/*
+ * Write workspace and maximized state of all windows to _MCWM_STATE
+ * on the root if anything changed since last time.
+ */
+void writestate(void)
 {
     struct item *item;
     struct client *client;
+    struct winstate *state;
+    uint32_t *blob;
+    uint32_t num = 0;
 
-    if (ws == curws)
+    if (!statedirty)
     {
-        PDEBUG("Changing to same workspace!\n");
         return;
     }
 
-    PDEBUG("Changing from workspace #%d to #%d\n", curws, ws);
-
-    /*
-     * We lose our focus if the window we focus isn't fixed. An
-     * EnterNotify event will set focus later.
-     */
-    if (NULL != focuswin && !focuswin->fixed)
+    for (item = winlist; item != NULL; item = item->next)
     {
-        setunfocus(focuswin->id);
-        focuswin = NULL;
+        num ++;
     }
 
-    /* Go through list of current ws. Unmap everything that isn't fixed. */
-    for (item = wslist[curws]; item != NULL; item = item->next)
+    blob = malloc(sizeof (uint32_t) + num * sizeof (struct winstate));
+    if (NULL == blob)
     {
-        client = item->data;
-
-        PDEBUG("changeworkspace. unmap phase. ws #%d, client-fixed: %d\n",
-               curws, client->fixed);
-
-        if (!client->fixed)
-        {
-            /*
-             * This is an ordinary window. Just unmap it. Note that
-             * this will generate an unnecessary UnmapNotify event
-             * which we will try to handle later.
-             */
-            xcb_unmap_window(conn, client->id);
-        }
+        PDEBUG("writestate: Out of memory.\n");
+        return;
     }
 
-    /* Go through list of new ws. Map everything that isn't fixed. */
-    for (item = wslist[ws]; item != NULL; item = item->next)
+    blob[0] = STATE_VERSION;
+    state = (struct winstate *) &blob[1];
+
+    for (item = winlist; item != NULL; item = item->next, state ++)
     {
         client = item->data;
 
-        PDEBUG("changeworkspace. map phase. ws #%d, client-fixed: %d\n",
-               ws, client->fixed);
-
-        /* Fixed windows are already mapped. Map everything else. */
-        if (!client->fixed)
+        state->id = client->id;
+        state->ws = client->fixed ? NET_WM_FIXED : client->ws;
+        state->flags = 0;
+        if (client->maxed)
         {
-            xcb_map_window(conn, client->id);
+            state->flags |= STATE_MAXED;
+        }
+        if (client->vertmaxed)
+        {
+            state->flags |= STATE_VERTMAXED;
         }
+        state->x = client->origsize.x;
+        state->y = client->origsize.y;
+        state->width = client->origsize.width;
+        state->height = client->origsize.height;
     }
 
-    xcb_flush(conn);
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
+                        atom_state, XCB_ATOM_CARDINAL, 32,
+                        1 + num * (sizeof (struct winstate) / 4), blob);
 
-    curws = ws;
+    free(blob);
+
+    statedirty = false;
 }
 
 /*
- * Fix or unfix a window client from all workspaces. If setcolour is
- * set, also change back to ordinary focus colour when unfixing.
+ * Collect the _MCWM_STATE property asked for with cookie and put all
+ * windows in it in tab, pointing to their struct winstate. The
+ * structs live in *reply, which the caller frees when done with tab.
+ *
+ * Returns the number of windows found. 0 if there was no state or we
+ * didn't understand it.
  */
-void fixwindow(struct client *client, bool setcolour)
+int readstate(xcb_get_property_cookie_t cookie, struct hashtab *tab,
+              xcb_get_property_reply_t **reply)
 {
-    uint32_t values[1];
-    uint32_t ws;
+    uint32_t *blob;
+    struct winstate *state;
+    int len;
+    int num;
+    int i;
 
-    if (NULL == client)
+    *reply = waitreply(cookie.sequence, NULL);
+    if (NULL == *reply || 32 != (*reply)->format)
     {
-        return;
+        return 0;
     }
 
-    if (client->fixed)
+    len = xcb_get_property_value_length(*reply) / 4;
+    blob = xcb_get_property_value(*reply);
+    if (len < 1 || STATE_VERSION != blob[0])
     {
-        client->fixed = false;
-        setwmdesktop(client->id, curws);
-
-        if (setcolour)
-        {
-            /* Set border color to ordinary focus colour. */
-            values[0] = conf.focuscol;
-            xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
-                                         values);
-        }
-
-        /* Delete from all workspace lists except current. */
-        for (ws = 0; ws < WORKSPACES; ws ++)
-        {
-            if (ws != curws)
-            {
-                delfromworkspace(client, ws);
-            }
-        }
+        PDEBUG("No _MCWM_STATE we understand.\n");
+        return 0;
     }
-    else
-    {
-        /*
-         * First raise the window. If we're going to another desktop
-         * we don't want this fixed window to be occluded behind
-         * something else.
-         */
-        raisewindow(client->id);
-
-        client->fixed = true;
-        setwmdesktop(client->id, NET_WM_FIXED);
 
-        /* Add window to all workspace lists. */
-        for (ws = 0; ws < WORKSPACES; ws ++)
-        {
-            if (ws != curws)
-            {
-                addtoworkspace(client, ws);
-            }
-        }
+    num = (len - 1) / (sizeof (struct winstate) / 4);
+    if (0 == num || 0 != hashinit(tab, num))
+    {
+        PDEBUG("readstate: Out of memory.\n");
+        return 0;
+    }
 
-        if (setcolour)
+    state = (struct winstate *) &blob[1];
+    for (i = 0; i < num; i ++)
+    {
+        if (0 != state[i].id && 0 != hashadd(tab, state[i].id, &state[i]))
         {
-            /* Set border color to fixed colour. */
-            values[0] = conf.fixedcol;
-            xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
-                                         values);
+            PDEBUG("readstate: Out of memory.\n");
+            hashfree(tab);
+            return 0;
         }
     }
 
-    xcb_flush(conn);
+    PDEBUG("Found %d windows in _MCWM_STATE.\n", num);
+
+    return num;
 }
 
 /*
- * Get the pixel values of a named colour colstr.
- *
- * Returns pixel values.
- * */
-uint32_t getcolor(const char *colstr)
+ * Put maximized state saved by an earlier mcwm back on client. Call
+ * after client is on its monitor and workspace.
+ */
+void restorestate(struct client *client, struct winstate *state)
 {
-    xcb_alloc_named_color_reply_t *col_reply;
-    xcb_colormap_t colormap;
-    xcb_generic_error_t *error;
-    xcb_alloc_named_color_cookie_t colcookie;
-
-    colormap = screen->default_colormap;
-    colcookie = xcb_alloc_named_color(conn, colormap, strlen(colstr), colstr);
-    col_reply = xcb_alloc_named_color_reply(conn, colcookie, &error);
-    if (NULL != error)
+    if (state->flags & STATE_MAXED)
     {
-        fprintf(stderr, "mcwm: Couldn't get pixel value for colour %s. "
-                "Exiting.\n", colstr);
-
-        xcb_disconnect(conn);
-        exit(1);
+        /*
+         * Maximize again in case the monitor changed while we were
+         * gone, then remember the size from before.
+         */
+        maximize(client);
+    }
+    else if (state->flags & STATE_VERTMAXED)
+    {
+        client->vertmaxed = true;
+    }
+    else
+    {
+        return;
     }
 
-    return col_reply->pixel;
+    client->origsize.x = state->x;
+    client->origsize.y = state->y;
+    client->origsize.width = state->width;
+    client->origsize.height = state->height;
 }
 
-/* Forget everything about client client. */
-void forgetclient(struct client *client)
+/*
+ * Ask for the EWMH workspace hint on window win. Use getwmdesktop()
+ * to collect the answer.
+ */
+xcb_get_property_cookie_t getwmdesktopcookie(xcb_drawable_t win)
+{
+    return xcb_get_property(conn, false, win, atom_desktop,
+                            XCB_GET_PROPERTY_TYPE_ANY, 0,
+                            sizeof (int32_t));
+}
+
+/*
+ * Get EWWM hint so we might know what workspace window win should be
+ * visible on. cookie is what getwmdesktopcookie() returned.
+ *
+ * Returns either workspace, NET_WM_FIXED if this window should be
+ * visible on all workspaces or MCWM_NOWS if we didn't find any hints.
+ */
+int32_t getwmdesktop(xcb_drawable_t win, xcb_get_property_cookie_t cookie)
 {
+    xcb_get_property_reply_t *reply;
+    uint32_t *wsp;
     uint32_t ws;
 
-    if (NULL == client)
+    reply = waitreply(cookie.sequence, NULL);
+    if (NULL == reply)
     {
-        PDEBUG("forgetclient: client was NULL\n");
-        return;
+        fprintf(stderr, "mcwm: Couldn't get properties for win %d\n", win);
+        return MCWM_NOWS;
     }
 
-    /*
-     * Delete this client from whatever workspace lists it belongs to.
-     * Note that it's OK to be on several workspaces at once even if
-     * you're not fixed.
-     */
-    for (ws = 0; ws < WORKSPACES; ws ++)
+    /* Length is 0 if we didn't find it. */
+    if (0 == xcb_get_property_value_length(reply))
     {
-        if (NULL != client->wsitem[ws])
-        {
-            delfromworkspace(client, ws);
-        }
+        PDEBUG("_NET_WM_DESKTOP reply was 0 length.\n");
+        goto bad;
     }
 
-    /* Remove from global window list. */
-    freeitem(&winlist, NULL, client->winitem);
-}
-
-/* Forget everything about a client with client->id win. */
-void forgetwin(xcb_window_t win)
-{
-    struct item *item;
-    struct client *client;
-    uint32_t ws;
+    wsp = xcb_get_property_value(reply);
 
-    /* Find this window in the global window list. */
-    for (item = winlist; item != NULL; item = item->next)
-    {
-        client = item->data;
+    ws = *wsp;
 
-        /*
-         * Forget about it completely and free allocated data.
-         *
-         * Note that it might already be freed by handling an
-         * UnmapNotify, so it isn't necessarily an error if we don't
-         * find it.
-         */
-        PDEBUG("Win %d == client ID %d\n", win, client->id);
-        if (win == client->id)
-        {
-            /* Found it. */
-            PDEBUG("Found it. Forgetting...\n");
+    PDEBUG("got _NET_WM_DESKTOP: %d stored at %p.\n", ws, (void *)wsp);
 
-            /*
-             * Delete window from whatever workspace lists it belonged
-             * to. Note that it's OK to be on several workspaces at
-             * once.
-             */
-            for (ws = 0; ws < WORKSPACES; ws ++)
-            {
-                PDEBUG("Looking in ws #%d.\n", ws);
-                if (NULL == client->wsitem[ws])
-                {
-                    PDEBUG("  but it wasn't there.\n");
-                }
-                else
-                {
-                    PDEBUG("  found it here. Deleting!\n");
-                    delfromworkspace(client, ws);
-                }
-            }
+    free(reply);
 
-            free(item->data);
-            delitem(&winlist, item);
+    return ws;
 
-            return;
-        }
-    }
+bad:
+    free(reply);
+    return MCWM_NOWS;
 }
 
 /*
- * Fit client on physical screen, moving and resizing as necessary.
+ * Set up an empty workspace set.
+ *
+ * Returns 0 on success.
  */
-void fitonscreen(struct client *client)
+int initwsset(struct wsset *set)
 {
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
-    bool willmove = false;
-    bool willresize = false;
-
-    client->vertmaxed = false;
+    uint32_t ws;
 
-    if (client->maxed)
+    set->curws = 0;
+    set->fixedlist = NULL;
+    set->clients = NULL;
+    set->others = NULL;
+    set->otherssize = 0;
+    set->wslist = calloc(conf.workspaces, sizeof (struct item *));
+    if (NULL == set->wslist)
     {
-        client->maxed = false;
-        setborders(client, conf.borderwidth);
+        return -1;
     }
 
-    if (NULL == client->monitor)
+    set->space = calloc(conf.workspaces, sizeof (struct wsspace));
+    if (NULL == set->space)
     {
-        /*
-         * This window isn't attached to any physical monitor. This
-         * probably means there is no RANDR, so we use the root window
-         * size.
-         */
-        mon_x = 0;
-        mon_y = 0;
-        mon_width = screen->width_in_pixels;
-        mon_height = screen->height_in_pixels;
+        free(set->wslist);
+        return -1;
     }
-    else
+
+    for (ws = 0; ws < conf.workspaces; ws ++)
     {
-        mon_x = client->monitor->x;
-        mon_y = client->monitor->y;
-        mon_width = client->monitor->width;
-        mon_height = client->monitor->height;
+        set->space[ws].stale = true;
     }
 
-    PDEBUG("Is window outside monitor?\n");
-    PDEBUG("x: %d between %d and %d?\n", client->x, mon_x, mon_x + mon_width);
-    PDEBUG("y: %d between %d and %d?\n", client->y, mon_y, mon_y + mon_height);
+    return 0;
+}
 
-    /* Is it outside the physical monitor? */
-    if (client->x > mon_x + mon_width)
-    {
-        client->x = mon_x + mon_width - client->width;
-        willmove = true;
-    }
-    if (client->y > mon_y + mon_height)
+/* Forget everything in the workspace set set. */
+void freewsset(struct wsset *set)
+{
+    uint32_t ws;
+
+    for (ws = 0; ws < conf.workspaces; ws ++)
     {
-        client->y = mon_y + mon_height - client->height;
-        willmove = true;
+        spacefree(&set->space[ws].free);
     }
 
-    if (client->x < mon_x)
+    free(set->space);
+    free(set->wslist);
+    free(set->others);
+}
+
+/* Find the workspace set of monitor mon, which might be NULL. */
+struct wsset *wssetof(struct monitor *mon)
+{
+    if (NULL == mon)
     {
-        client->x = mon_x;
-        willmove = true;
+        return &rootws;
     }
-    if (client->y < mon_y)
+
+    return &mon->wsset;
+}
+
+/* Find the workspace set we're working on. */
+struct wsset *curset(void)
+{
+    return wssetof(curmon);
+}
+
+/*
+ * Move client to monitor mon, which might be NULL. Moves the client
+ * to the workspace set of mon as well. A window that was visible
+ * goes on the current workspace of mon and stays visible. A hidden
+ * window keeps its workspace number and is mapped if that happens to
+ * be the current workspace of mon.
+ */
+void setmonitor(struct client *client, struct monitor *mon)
+{
+    struct wsset *set;
+    bool inws;
+    bool visible;
+
+    if (client->monitor == mon && NULL != client->monitem)
     {
-        client->y = mon_y;
-        willmove = true;
+        return;
     }
 
-    /* Is it smaller than it wants to  be? */
-    if (0 != client->min_height && client->height < client->min_height)
+    inws = NULL != client->wsitem;
+    visible = onworkspace(client);
+
+    if (inws)
     {
-        client->height = client->min_height;
-        willresize = true;
+        delfromworkspace(client);
     }
 
-    if (0 != client->min_width && client->width < client->min_width)
+    if (NULL != client->monitem)
     {
-        client->width = client->min_width;
-        willresize = true;
+        delitem(&wssetof(client->monitor)->clients, client->monitem);
+        client->monitem = NULL;
     }
 
-    /*
-     * If the window is larger than our screen, just place it in the
-     * corner and resize.
-     */
-    if (client->width + conf.borderwidth * 2 > mon_width)
+    client->monitor = mon;
+    set = wssetof(mon);
+
+    client->monitem = additem(&set->clients);
+    if (NULL == client->monitem)
     {
-        client->x = mon_x;
-        client->width = mon_width - conf.borderwidth * 2;;
-        willmove = true;
-        willresize = true;
+        PDEBUG("setmonitor: Out of memory.\n");
     }
-    else if (client->x + client->width + conf.borderwidth * 2
-             > mon_x + mon_width)
+    else
     {
-        client->x = mon_x + mon_width - (client->width + conf.borderwidth * 2);
-        willmove = true;
+        client->monitem->data = client;
     }
 
-    if (client->height + conf.borderwidth * 2 > mon_height)
+    if (!inws)
     {
-        client->y = mon_y;
-        client->height = mon_height - conf.borderwidth * 2;
-        willmove = true;
-        willresize = true;
+        return;
     }
-    else if (client->y + client->height + conf.borderwidth * 2
-             > mon_y + mon_height)
+
+    if (client->fixed)
     {
-        client->y = mon_y + mon_height - (client->height + conf.borderwidth
-                                          * 2);
-        willmove = true;
+        client->wsitem = additem(&set->fixedlist);
+        if (NULL != client->wsitem)
+        {
+            client->wsitem->data = client;
+        }
+        stalespace(set);
+        return;
     }
 
-    if (willmove)
+    addtoworkspace(client, visible ? set->curws : client->ws);
+
+    if (!visible && client->ws == set->curws)
     {
-        PDEBUG("Moving to %d,%d.\n", client->x, client->y);
-        movewindow(client->id, client->x, client->y);
+        xcb_map_window(conn, client->id);
     }
+}
 
-    if (willresize)
+/* Find the window list client is on. */
+struct item **wslistof(struct client *client)
+{
+    struct wsset *set = wssetof(client->monitor);
+
+    if (client->fixed)
     {
-        PDEBUG("Resizing to %d x %d.\n", client->width, client->height);
-        resize(client->id, client->width, client->height);
+        return &set->fixedlist;
     }
+
+    return &set->wslist[client->ws];
+}
+
+/* Check if client is visible on the current workspace of its monitor. */
+bool onworkspace(struct client *client)
+{
+    return NULL != client->wsitem
+        && (client->fixed || client->ws == wssetof(client->monitor)->curws);
 }
 
 /*
- * Set position, geometry and attributes of a new window and show it
- * on the screen.
+ * The window ring of the current workspace is the workspace's own
+ * windows followed by the fixed windows on the same monitor. Get the
+ * first window in the ring.
+ *
+ * Returns NULL if the ring is empty.
  */
-void newwin(xcb_window_t win)
+struct item *ringfirst(void)
 {
-    struct client *client;
+    struct wsset *set = curset();
 
-    if (NULL != findclient(win))
+    if (NULL != set->wslist[set->curws])
     {
-        /*
-         * We know this window from before. It's trying to map itself
-         * on the current workspace, but since it's unmapped it
-         * probably belongs on another workspace. We don't like that.
-         * Silently ignore.
-         */
-        return;
+        return set->wslist[set->curws];
     }
 
-    /*
-     * Set up stuff, like borders, add the window to the client list,
-     * et cetera.
-     */
-    client = setupwin(win);
-    if (NULL == client)
+    return set->fixedlist;
+}
+
+/* Get the last window in the window ring, or NULL if empty. */
+struct item *ringlast(void)
+{
+    struct wsset *set = curset();
+    struct item *item;
+
+    item = NULL != set->fixedlist ? set->fixedlist : set->wslist[set->curws];
+    if (NULL == item)
     {
-        fprintf(stderr, "mcwm: Couldn't set up window. Out of memory.\n");
-        return;
+        return NULL;
     }
 
-    /* Add this window to the current workspace. */
-    addtoworkspace(client, curws);
-
-    /*
-     * If the client doesn't say the user specified the coordinates
-     * for the window we map it where our pointer is instead.
-     */
-    if (!client->usercoord)
+    while (NULL != item->next)
     {
-        int16_t pointx;
-        int16_t pointy;
-        PDEBUG("Coordinates not set by user. Using pointer: %d,%d.\n",
-               pointx, pointy);
+        item = item->next;
+    }
 
-        /* Get pointer position so we can move the window to the cursor. */
-        if (!getpointer(screen->root, &pointx, &pointy))
-        {
-            PDEBUG("Failed to get pointer coords!\n");
-            pointx = 0;
-            pointy = 0;
-        }
+    return item;
+}
 
-        client->x = pointx;
-        client->y = pointy;
+/* Get the window after item in the window ring, or NULL if last. */
+struct item *ringnext(struct item *item)
+{
+    struct client *client = item->data;
 
-        movewindow(client->id, client->x, client->y);
-    }
-    else
+    if (NULL != item->next)
     {
-        PDEBUG("User set coordinates.\n");
+        return item->next;
     }
 
-    /* Find the physical output this window will be on if RANDR is active. */
-    if (-1 != randrbase)
+    if (!client->fixed)
     {
-        client->monitor = findmonbycoord(client->x, client->y);
-        if (NULL == client->monitor)
-        {
-            /*
-             * Window coordinates are outside all physical monitors.
-             * Choose the first screen.
-             */
-            if (NULL != monlist)
-            {
-                client->monitor = monlist->data;
-            }
-        }
+        return wssetof(client->monitor)->fixedlist;
     }
 
-    fitonscreen(client);
+    return NULL;
+}
 
-    /* Show window on screen. */
-    xcb_map_window(conn, client->id);
+/* Get the window before item in the window ring, or NULL if first. */
+struct item *ringprev(struct item *item)
+{
+    struct client *client = item->data;
+    struct wsset *set = wssetof(client->monitor);
 
-    /* Declare window normal. */
-    long data[] = { XCB_ICCCM_WM_STATE_NORMAL, XCB_NONE };
-    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
-                              wm_state, wm_state, 32, 2, data);
+    if (NULL != item->prev)
+    {
+        return item->prev;
+    }
 
-    /*
-     * Move cursor into the middle of the window so we don't lose the
-     * pointer to another window.
-     */
-    xcb_warp_pointer(conn, XCB_NONE, win, 0, 0, 0, 0,
-                     client->width / 2, client->height / 2);
+    if (client->fixed && NULL != set->wslist[set->curws])
+    {
+        for (item = set->wslist[set->curws]; NULL != item->next;
+             item = item->next)
+            ;
 
-    xcb_flush(conn);
+        return item;
+    }
+
+    return NULL;
 }
 
-/* Set border colour, width and event mask for window. */
-struct client *setupwin(xcb_window_t win)
+/*
+ * Unmap client's window without forgetting about it. We remember to
+ * ignore the UnmapNotify it generates.
+ */
+void unmapwin(struct client *client)
+{
+    client->unmaps ++;
+    xcb_unmap_window(conn, client->id);
+}
+
+/*
+ * Add a window, specified by client, to workspace ws on its
+ * monitor.
+ */
+void addtoworkspace(struct client *client, uint32_t ws)
 {
-    uint32_t mask = 0;
-    uint32_t values[2];
     struct item *item;
-    struct client *client;
-    xcb_size_hints_t hints;
-    uint32_t ws;
 
-    /* Set default border color. */
-    values[0] = conf.unfocuscol;
-    xcb_change_window_attributes(conn, win, XCB_CW_BORDER_PIXEL, values);
+    item = additem(&wssetof(client->monitor)->wslist[ws]);
+    if (NULL == item)
+    {
+        PDEBUG("addtoworkspace: Out of memory.\n");
+        return;
+    }
 
-    /* Subscribe to events we want to know about in this window. */
-    mask = XCB_CW_EVENT_MASK;
-    values[0] = XCB_EVENT_MASK_ENTER_WINDOW;
-    xcb_change_window_attributes_checked(conn, win, mask, values);
+    /* Remember our place in the workspace window list. */
+    client->wsitem = item;
+    client->ws = ws;
+
+    /* Remember the data. */
+    item->data = client;
+
+    /* It's not free space anymore. */
+    usespace(client);
 
     /*
-     * Add this window to the X Save Set, that is, the windows that
-     * will be automatically restored if we die.
+     * Set window hint property so we can survive a crash.
+     *
+     * Fixed windows have their own special WM hint. We don't want to
+     * mess with that.
      */
-    xcb_change_save_set(conn, XCB_SET_MODE_INSERT, win);
-
-    xcb_flush(conn);
+    if (!client->fixed)
+    {
+        setwmdesktop(client, ws);
+    }
+}
 
-    /* Remember window and store a few things about it. */
+/* Delete window client from its workspace, or from the fixed list. */
+void delfromworkspace(struct client *client)
+{
+    delitem(wslistof(client), client->wsitem);
+    givespace(client);
 
-    item = additem(&winlist);
+    /* Reset our place in the workspace window list. */
+    client->wsitem = NULL;
+}
 
-    if (NULL == item)
+/* Get the area of monitor mon, or of the whole root if NULL. */
+void monarea(struct monitor *mon, struct area *area)
+{
+    if (NULL == mon)
     {
-        PDEBUG("newwin: Out of memory.\n");
-        return NULL;
+        area->x = 0;
+        area->y = 0;
+        area->width = screen->width_in_pixels;
+        area->height = screen->height_in_pixels;
     }
-
-    client = malloc(sizeof (struct client));
-    if (NULL == client)
+    else
     {
-        PDEBUG("newwin: Out of memory.\n");
-        return NULL;
+        area->x = mon->x;
+        area->y = mon->y;
+        area->width = mon->width;
+        area->height = mon->height;
     }
+}
 
-    item->data = client;
-
-    /* Initialize client. */
-    client->id = win;
-    client->usercoord = false;
-    client->x = 0;
-    client->y = 0;
-    client->width = 0;
-    client->height = 0;
-    client->min_width = 0;
-    client->min_height = 0;
-    client->max_width = screen->width_in_pixels;
-    client->max_height = screen->height_in_pixels;
-    client->base_width = 0;
-    client->base_height = 0;
-    client->width_inc = 1;
-    client->height_inc = 1;
-    client->vertmaxed = false;
-    client->maxed = false;
-    client->fixed = false;
-    client->monitor = NULL;
+/* Get the area client covers on screen, borders included. */
+void clientarea(struct client *client, struct area *area)
+{
+    area->x = client->x;
+    area->y = client->y;
+    area->width = client->width + 2 * conf.borderwidth;
+    area->height = client->height + 2 * conf.borderwidth;
+}
 
-    client->winitem = item;
+/* Build the free space of all workspaces in set again when needed. */
+void stalespace(struct wsset *set)
+{
+    uint32_t ws;
 
-    for (ws = 0; ws < WORKSPACES; ws ++)
+    for (ws = 0; ws < conf.workspaces; ws ++)
     {
-        client->wsitem[ws] = NULL;
+        set->space[ws].stale = true;
     }
+}
 
-    PDEBUG("Adding window %d\n", client->id);
+/* Get the area client took from the free space, borders included. */
+void placedarea(struct client *client, struct area *area)
+{
+    area->x = client->placed.x;
+    area->y = client->placed.y;
+    area->width = client->placed.width + 2 * conf.borderwidth;
+    area->height = client->placed.height + 2 * conf.borderwidth;
+}
 
-    setborders(client, conf.borderwidth);
+/*
+ * Client moved or went away. Give back the space it took up to the
+ * free space of its workspace. A fixed window took up space on all
+ * workspaces, so those are built again next time we need them.
+ */
+void givespace(struct client *client)
+{
+    struct wsset *set = wssetof(client->monitor);
+    struct wsspace *space;
+    struct item *lists[2];
+    struct item *item;
+    struct area *others;
+    struct area freed;
+    uint32_t size;
+    uint32_t num = 0;
+    int i;
 
-    /* Get window geometry. */
-    if (!getgeom(client->id, &client->x, &client->y, &client->width,
-                 &client->height))
+    if (client->fixed)
     {
-        fprintf(stderr, "Couldn't get geometry in initial setup of window.\n");
+        stalespace(set);
+        return;
     }
 
-    /*
-     * Get the window's incremental size step, if any.
-     */
-    if (!xcb_icccm_get_wm_normal_hints_reply(
-            conn, xcb_icccm_get_wm_normal_hints_unchecked(
-                conn, win), &hints, NULL))
+    if (client->ws >= conf.workspaces || set->space[client->ws].stale)
     {
-        PDEBUG("Couldn't get size hints.\n");
+        return;
     }
 
-    /*
-     * The user specified the position coordinates. Remember that so
-     * we can use geometry later.
-     */
-    if (hints.flags & XCB_ICCCM_SIZE_HINT_US_POSITION)
+    space = &set->space[client->ws];
+    lists[0] = set->wslist[client->ws];
+    lists[1] = set->fixedlist;
+
+    /* Everything else still in use there. */
+    for (i = 0; i < 2; i ++)
     {
-        client->usercoord = true;
+        for (item = lists[i]; item != NULL; item = item->next)
+        {
+            if (item->data == client)
+            {
+                continue;
+            }
+
+            if (num == set->otherssize)
+            {
+                size = 0 == set->otherssize ? 32 : set->otherssize * 2;
+                others = realloc(set->others, size * sizeof (struct area));
+                if (NULL == others)
+                {
+                    PDEBUG("givespace: Out of memory.\n");
+                    space->stale = true;
+                    return;
+                }
+
+                set->others = others;
+                set->otherssize = size;
+            }
+
+            placedarea(item->data, &set->others[num ++]);
+        }
     }
 
-    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE)
+    placedarea(client, &freed);
+    if (0 != spacegive(&space->free, &freed, set->others, num))
     {
-        client->min_width = hints.min_width;
-        client->min_height = hints.min_height;
+        PDEBUG("givespace: Out of memory.\n");
     }
+}
 
-    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE)
-    {
+/*
+ * Client was just added to its workspace or moved there. Take its
+ * area from the free space there.
+ */
+void usespace(struct client *client)
+{
+    struct wsspace *space;
+    struct area area;
 
-        client->max_width = hints.max_width;
-        client->max_height = hints.max_height;
-    }
+    client->placed.x = client->x;
+    client->placed.y = client->y;
+    client->placed.width = client->width;
+    client->placed.height = client->height;
 
-    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC)
+    if (client->fixed || client->ws >= conf.workspaces)
     {
-        client->width_inc = hints.width_inc;
-        client->height_inc = hints.height_inc;
-
-        PDEBUG("widht_inc %d\nheight_inc %d\n", client->width_inc,
-               client->height_inc);
+        return;
     }
 
-    if (hints.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE)
+    space = &wssetof(client->monitor)->space[client->ws];
+    if (space->stale)
     {
-        client->base_width = hints.base_width;
-        client->base_height = hints.base_height;
+        return;
     }
 
-    return client;
+    clientarea(client, &area);
+    if (0 != spaceuse(&space->free, &area))
+    {
+        PDEBUG("usespace: Out of memory.\n");
+    }
 }
 
 /*
- * Get a keycode from a keysym.
- *
- * Returns keycode value.
+ * Build the free space of workspace ws in set, which is on monitor
+ * mon, from the windows there now.
  */
-xcb_keycode_t keysymtokeycode(xcb_keysym_t keysym, xcb_key_symbols_t *keysyms)
+static void buildspace(struct wsset *set, uint32_t ws, struct monitor *mon)
 {
-    xcb_keycode_t *keyp;
-    xcb_keycode_t key;
+    struct wsspace *space = &set->space[ws];
+    struct item *lists[2];
+    struct item *item;
+    struct client *client;
+    struct area area;
+    int i;
 
-    /* We only use the first keysymbol, even if there are more. */
-    keyp = xcb_key_symbols_get_keycode(keysyms, keysym);
-    if (NULL == keyp)
+    monarea(mon, &area);
+    if (0 != spaceinit(&space->free, &area))
     {
-        fprintf(stderr, "mcwm: Couldn't look up key. Exiting.\n");
-        exit(1);
-        return 0;
+        PDEBUG("buildspace: Out of memory.\n");
+        return;
     }
 
-    key = *keyp;
-    free(keyp);
+    lists[0] = set->wslist[ws];
+    lists[1] = set->fixedlist;
 
-    return key;
+    for (i = 0; i < 2; i ++)
+    {
+        for (item = lists[i]; item != NULL; item = item->next)
+        {
+            client = item->data;
+
+            client->placed.x = client->x;
+            client->placed.y = client->y;
+            client->placed.width = client->width;
+            client->placed.height = client->height;
+
+            clientarea(client, &area);
+            spaceuse(&space->free, &area);
+        }
+    }
+
+    space->stale = false;
 }
 
 /*
- * Set up all shortcut keys.
+ * Find free space for client on the current workspace of the current
+ * monitor and put it there.
  *
- * Returns 0 on success, non-zero otherwise.
+ * Returns true if we found space.
  */
-int setupkeys(void)
+bool placewindow(struct client *client)
 {
-    xcb_key_symbols_t *keysyms;
-    unsigned i;
-
-    /* Get all the keysymbols. */
-    keysyms = xcb_key_symbols_alloc(conn);
+    struct monitor *mon = curmon;
+    struct wsset *set;
+    struct wsspace *space;
+    struct area found;
 
-    /*
-     * Find out what keys generates our MODKEY mask. Unfortunately it
-     * might be several keys.
-     */
-    if (NULL != modkeys.keycodes)
+    /* Nothing has focus yet. Use the first monitor if we have any. */
+    if (NULL == mon && 0 != montab.num)
     {
-        free(modkeys.keycodes);
+        mon = montab.rects[0].mon;
     }
-    modkeys = getmodkeys(MODKEY);
 
-    if (0 == modkeys.len)
+    set = wssetof(mon);
+    space = &set->space[set->curws];
+
+    if (space->stale)
     {
-        fprintf(stderr, "We couldn't find any keycodes to our main modifier "
-                "key!\n");
-        return -1;
+        buildspace(set, set->curws, mon);
     }
 
-    for (i = 0; i < modkeys.len; i ++)
+    if (!spacefind(&space->free, client->width + 2 * conf.borderwidth,
+                   client->height + 2 * conf.borderwidth, &found))
     {
-        /*
-         * Grab the keys that are bound to MODKEY mask with any other
-         * modifier.
-         */
-        xcb_grab_key(conn, 1, screen->root, XCB_MOD_MASK_ANY,
-                     modkeys.keycodes[i],
-                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+        PDEBUG("No free space for %dx%d.\n", client->width,
+               client->height);
+        return false;
     }
 
-    /* Now grab the rest of the keys with the MODKEY modifier. */
-    for (i = KEY_F; i < KEY_MAX; i ++)
-    {
-        if (XK_VoidSymbol == keys[i].keysym)
-        {
-            keys[i].keycode = 0;
-            continue;
-        }
+    client->x = found.x;
+    client->y = found.y;
 
-        keys[i].keycode = keysymtokeycode(keys[i].keysym, keysyms);
-        if (0 == keys[i].keycode)
-        {
-            /* Couldn't set up keys! */
+    return true;
+}
 
-            /* Get rid of key symbols. */
-            xcb_key_symbols_free(keysyms);
+/* Change current workspace on the current monitor to ws. */
+void changeworkspace(uint32_t ws)
+{
+    struct wsset *set = curset();
+    struct item *item;
+    struct client *client;
 
-            return -1;
-        }
+    if (ws == set->curws)
+    {
+        PDEBUG("Changing to same workspace!\n");
+        return;
+    }
 
-        /* Grab other keys with a modifier mask. */
-        xcb_grab_key(conn, 1, screen->root, MODKEY, keys[i].keycode,
-                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+    if (ws >= conf.workspaces)
+    {
+        PDEBUG("No workspace #%d.\n", ws);
+        return;
+    }
 
-        /*
-         * XXX Also grab it's shifted counterpart. A bit ugly here
-         * because we grab all of them not just the ones we want.
-         */
-        xcb_grab_key(conn, 1, screen->root, MODKEY | SHIFTMOD,
-                     keys[i].keycode,
-                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+    PDEBUG("Changing from workspace #%d to #%d\n", set->curws, ws);
+
+    /*
+     * We lose our focus if the window we focus isn't fixed. An
+     * EnterNotify event will set focus later.
+     */
+    if (NULL != focuswin && !focuswin->fixed
+        && wssetof(focuswin->monitor) == set)
+    {
+        setunfocus(focuswin->id);
+        focuswin = NULL;
     }
 
-    /* Need this to take effect NOW! */
-    xcb_flush(conn);
+    /*
+     * In atomic mode, nobody else gets to talk to the server until
+     * we're done, so no client repaints in the middle of the switch.
+     * We map the new windows first so the root is never exposed
+     * between the workspaces.
+     *
+     * The X server keeps unmapped windows in the stacking order, so
+     * the new workspace comes back stacked the way we left it.
+     */
+    if (conf.atomicswitch)
+    {
+        xcb_grab_server(conn);
 
-    /* Get rid of the key symbols table. */
-    xcb_key_symbols_free(keysyms);
+        for (item = set->wslist[ws]; item != NULL; item = item->next)
+        {
+            client = item->data;
+            xcb_map_window(conn, client->id);
+        }
+    }
 
-    return 0;
+    /*
+     * Go through list of current ws and unmap everything. Fixed
+     * windows aren't on workspace lists, so they stay.
+     */
+    for (item = set->wslist[set->curws]; item != NULL; item = item->next)
+    {
+        client = item->data;
+
+        PDEBUG("changeworkspace. unmap phase. ws #%d, client %d\n",
+               set->curws, client->id);
+
+        unmapwin(client);
+    }
+
+    if (conf.atomicswitch)
+    {
+        xcb_ungrab_server(conn);
+    }
+    else
+    {
+        /* Go through list of new ws. Map everything. */
+        for (item = set->wslist[ws]; item != NULL; item = item->next)
+        {
+            client = item->data;
+
+            PDEBUG("changeworkspace. map phase. ws #%d, client %d\n",
+                   ws, client->id);
+
+            xcb_map_window(conn, client->id);
+        }
+    }
+
+    set->curws = ws;
 }
 
 /*
- * Walk through all existing windows and set them up.
- *
- * Returns 0 on success.
+ * Fix or unfix a window client from all workspaces. If setcolour is
+ * set, also change back to ordinary focus colour when unfixing.
  */
-int setupscreen(void)
+void fixwindow(struct client *client, bool setcolour)
 {
-    xcb_query_tree_reply_t *reply;
-    xcb_query_pointer_reply_t *pointer;
-    int i;
-    int len;
-    xcb_window_t *children;
-    xcb_get_window_attributes_reply_t *attr;
-    struct client *client;
-    uint32_t ws;
+    uint32_t values[1];
 
-    /* Get all children. */
-    reply = xcb_query_tree_reply(conn,
-                                 xcb_query_tree(conn, screen->root), 0);
-    if (NULL == reply)
+    if (NULL == client)
     {
-        return -1;
+        return;
     }
 
-    len = xcb_query_tree_children_length(reply);
-    children = xcb_query_tree_children(reply);
-
-    /* Set up all windows on this root. */
-    for (i = 0; i < len; i ++)
+    if (client->fixed)
     {
-        attr = xcb_get_window_attributes_reply(
-            conn, xcb_get_window_attributes(conn, children[i]), NULL);
+        /* Move from the fixed list to the current workspace. */
+        delfromworkspace(client);
+        client->fixed = false;
+        addtoworkspace(client, wssetof(client->monitor)->curws);
 
-        if (!attr)
+        if (setcolour)
         {
-            fprintf(stderr, "Couldn't get attributes for window %d.",
-                    children[i]);
-            continue;
+            /* Set border color to ordinary focus colour. */
+            values[0] = conf.focuscol;
+            xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
+                                         values);
         }
 
+    }
+    else
+    {
         /*
-         * Don't set up or even bother windows in override redirect
-         * mode.
-         *
-         * This mode means they wouldn't have been reported to us
-         * with a MapRequest if we had been running, so in the
-         * normal case we wouldn't have seen them.
-         *
-         * Only handle visible windows.
+         * First raise the window. If we're going to another desktop
+         * we don't want this fixed window to be occluded behind
+         * something else.
          */
-        if (!attr->override_redirect
-            && attr->map_state == XCB_MAP_STATE_VIEWABLE)
-        {
-            client = setupwin(children[i]);
-            if (NULL != client)
-            {
-                /*
-                 * Find the physical output this window will be on if
-                 * RANDR is active.
-                 */
-                if (-1 != randrbase)
-                {
-                    PDEBUG("Looking for monitor on %d x %d.\n", client->x,
-                        client->y);
-                    client->monitor = findmonbycoord(client->x, client->y);
-#if DEBUG
-                    if (NULL != client->monitor)
-                    {
-                        PDEBUG("Found client on monitor %s.\n",
-                               client->monitor->name);
-                    }
-                    else
-                    {
-                        PDEBUG("Couldn't find client on any monitor.\n");
-                    }
-#endif
-                }
+        raisewindow(client->id);
 
-                /* Fit window on physical screen. */
-                fitonscreen(client);
+        /* Move from its workspace to the fixed list. */
+        if (NULL != client->wsitem)
+        {
+            delfromworkspace(client);
+        }
 
-                /*
-                 * Check if this window has a workspace set already as
-                 * a WM hint.
-                 *
-                 */
-                ws = getwmdesktop(children[i]);
+        client->fixed = true;
+        setwmdesktop(client, NET_WM_FIXED);
 
-                if (ws == NET_WM_FIXED)
-                {
-                    /* Add to current workspace. */
-                    addtoworkspace(client, curws);
-                    /* Add to all other workspaces. */
-                    fixwindow(client, false);
-                }
-                else if (MCWM_NOWS != ws && ws < WORKSPACES)
-                {
-                    addtoworkspace(client, ws);
-                    /* If it's not our current workspace, hide it. */
-                    if (ws != curws)
-                    {
-                        xcb_unmap_window(conn, client->id);
-                    }
-                }
-                else
-                {
-                    /*
-                     * No workspace hint at all. Just add it to our
-                     * current workspace.
-                     */
-                    addtoworkspace(client, curws);
-                }
-            }
+        client->wsitem = additem(&wssetof(client->monitor)->fixedlist);
+        if (NULL == client->wsitem)
+        {
+            PDEBUG("fixwindow: Out of memory.\n");
+        }
+        else
+        {
+            client->wsitem->data = client;
         }
 
-        free(attr);
-    }
+        /* It takes up space on all workspaces now. */
+        stalespace(wssetof(client->monitor));
 
-    changeworkspace(0);
+        if (setcolour)
+        {
+            /* Set border color to fixed colour. */
+            values[0] = conf.fixedcol;
+            xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
+                                         values);
+        }
+    }
+}
 
-    /*
-     * Get pointer position so we can set focus on any window which
-     * might be under it.
-     */
-    pointer = xcb_query_pointer_reply(
-        conn, xcb_query_pointer(conn, screen->root), 0);
+/* Find the visual type with ID id on our screen. */
+xcb_visualtype_t *getvisual(xcb_visualid_t id)
+{
+    xcb_depth_iterator_t depths;
+    xcb_visualtype_iterator_t visuals;
 
-    if (NULL == pointer)
-    {
-        focuswin = NULL;
-    }
-    else
+    for (depths = xcb_screen_allowed_depths_iterator(screen); depths.rem;
+         xcb_depth_next(&depths))
     {
-        setfocus(findclient(pointer->child));
-        free(pointer);
+        for (visuals = xcb_depth_visuals_iterator(depths.data); visuals.rem;
+             xcb_visualtype_next(&visuals))
+        {
+            if (visuals.data->visual_id == id)
+            {
+                return visuals.data;
+            }
+        }
     }
 
-    xcb_flush(conn);
-
-    free(reply);
-
-    return 0;
+    return NULL;
 }
 
 /*
- * Set up RANDR extension. Get the extension base and subscribe to
- * events.
+ * Parse a hexadecimal colour in colstr, like "#ff8800", into rgb.
+ *
+ * Returns true if colstr was such a colour.
  */
-int setuprandr(void)
+bool parsehex(const char *colstr, uint8_t rgb[3])
 {
-    const xcb_query_extension_reply_t *extension;
-    int base;
+    unsigned int r;
+    unsigned int g;
+    unsigned int b;
+    int len;
 
-    extension = xcb_get_extension_data(conn, &xcb_randr_id);
-    if (!extension->present)
-    {
-        PDEBUG("No RANDR extension.\n");
-        return -1;
-    }
-    else
+    if ('#' != colstr[0] || 7 != strlen(colstr)
+        || 3 != sscanf(colstr, "#%2x%2x%2x%n", &r, &g, &b, &len)
+        || 7 != len)
     {
-        getrandr();
+        return false;
     }
 
-    base = extension->first_event;
-    PDEBUG("randrbase is %d.\n", base);
-
-    xcb_randr_select_input(conn, screen->root,
-                           XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE |
-                           XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE |
-                           XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE |
-                           XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY);
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
 
-    xcb_flush(conn);
-
-    return base;
+    return true;
 }
 
 /*
- * Get RANDR resources and figure out how many outputs there are.
+ * Scale 8-bit colour component value to the bits in a visual's
+ * colour mask.
+ *
+ * Returns the bits to or into the pixel value.
  */
-void getrandr(void)
+uint32_t maskpixel(uint8_t value, uint32_t mask)
 {
-    xcb_randr_get_screen_resources_current_cookie_t rcookie;
-    xcb_randr_get_screen_resources_current_reply_t *res;
-    xcb_randr_output_t *outputs;
-    int len;
-    xcb_timestamp_t timestamp;
+    uint32_t max;
+    int shift;
 
-    rcookie = xcb_randr_get_screen_resources_current(conn, screen->root);
-    res = xcb_randr_get_screen_resources_current_reply(conn, rcookie, NULL);
-    if (NULL == res)
+    if (0 == mask)
     {
-        printf("No RANDR extension available.\n");
-        return;
+        return 0;
     }
-    timestamp = res->config_timestamp;
-
-    len = xcb_randr_get_screen_resources_current_outputs_length(res);
-    outputs = xcb_randr_get_screen_resources_current_outputs(res);
 
-    PDEBUG("Found %d outputs.\n", len);
+    for (shift = 0; !(mask & (1 << shift)); shift ++)
+        ;
 
-    /* Request information for all outputs. */
-    getoutputs(outputs, len, timestamp);
+    max = mask >> shift;
 
-    free(res);
+    return ((value * max + 127) / 255) << shift;
 }
 
 /*
- * Walk through all the RANDR outputs (number of outputs == len) there
- * was at time timestamp.
+ * Get pixel values for num colours in cols.
+ *
+ * Hexadecimal colours on a TrueColor visual are computed from the
+ * visual's colour masks without asking the server. All other colours
+ * are allocated with the requests sent before waiting for any reply.
+ *
+ * Exits if we can't get a colour.
  */
-void getoutputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp)
+void getcolors(struct colordef *cols, int num)
 {
-    char *name;
-    xcb_randr_get_crtc_info_cookie_t icookie;
-    xcb_randr_get_crtc_info_reply_t *crtc = NULL;
-    xcb_randr_get_output_info_reply_t *output;
-    struct monitor *mon;
-    struct monitor *clonemon;
-    xcb_randr_get_output_info_cookie_t ocookie[len];
+    xcb_alloc_named_color_cookie_t namedcookies[num];
+    xcb_alloc_color_cookie_t hexcookies[num];
+    bool ishex[num];
+    bool asked[num];
+    xcb_visualtype_t *visual;
+    xcb_colormap_t colormap;
+    uint8_t rgb[3];
+    uint32_t pixel = 0;
+    bool failed;
     int i;
 
-    for (i = 0; i < len; i++)
+    colormap = screen->default_colormap;
+    visual = getvisual(screen->root_visual);
+
+    for (i = 0; i < num; i ++)
     {
-        ocookie[i] = xcb_randr_get_output_info(conn, outputs[i], timestamp);
+        ishex[i] = parsehex(cols[i].name, rgb);
+        asked[i] = true;
+
+        if (ishex[i] && NULL != visual
+            && XCB_VISUAL_CLASS_TRUE_COLOR == visual->_class)
+        {
+            *cols[i].pixel = maskpixel(rgb[0], visual->red_mask)
+                | maskpixel(rgb[1], visual->green_mask)
+                | maskpixel(rgb[2], visual->blue_mask);
+            asked[i] = false;
+        }
+        else if (ishex[i])
+        {
+            hexcookies[i] = xcb_alloc_color(conn, colormap, rgb[0] * 257,
+                                            rgb[1] * 257, rgb[2] * 257);
+        }
+        else
+        {
+            namedcookies[i] = xcb_alloc_named_color(conn, colormap,
+                                                    strlen(cols[i].name),
+                                                    cols[i].name);
+        }
     }
 
-    /* Loop through all outputs. */
-    for (i = 0; i < len; i ++)
+    failed = false;
+    for (i = 0; i < num; i ++)
     {
-        output = xcb_randr_get_output_info_reply(conn, ocookie[i], NULL);
-
-        if (output == NULL)
+        if (!asked[i])
         {
             continue;
         }
 
-        asprintf(&name, "%.*s",
-                 xcb_randr_get_output_info_name_length(output),
-                 xcb_randr_get_output_info_name(output));
-
-        PDEBUG("Name: %s\n", name);
-        PDEBUG("id: %d\n" , outputs[i]);
-        PDEBUG("Size: %d x %d mm.\n", output->mm_width, output->mm_height);
 
-        if (XCB_NONE != output->crtc)
+        if (ishex[i])
         {
-            icookie = xcb_randr_get_crtc_info(conn, output->crtc, timestamp);
-            crtc = xcb_randr_get_crtc_info_reply(conn, icookie, NULL);
-            if (NULL == crtc)
+            xcb_alloc_color_reply_t *reply;
+
+            reply = waitreply(hexcookies[i].sequence, NULL);
+            if (NULL != reply)
             {
-                return;
+                pixel = reply->pixel;
+                free(reply);
             }
-
-            PDEBUG("CRTC: at %d, %d, size: %d x %d.\n", crtc->x, crtc->y,
-                   crtc->width, crtc->height);
-
-            /* Check if it's a clone. */
-            clonemon = findclones(outputs[i], crtc->x, crtc->y);
-            if (NULL != clonemon)
+            else
             {
-                PDEBUG("Monitor %s, id %d is a clone of %s, id %d. Skipping.\n",
-                       name, outputs[i],
-                       clonemon->name, clonemon->id);
-                continue;
+                failed = true;
             }
+        }
+        else
+        {
+            xcb_alloc_named_color_reply_t *reply;
 
-            /* Do we know this monitor already? */
-            if (NULL == (mon = findmonitor(outputs[i])))
+            reply = waitreply(namedcookies[i].sequence, NULL);
+            if (NULL != reply)
             {
-                PDEBUG("Monitor not known, adding to list.\n");
-                addmonitor(outputs[i], name, crtc->x, crtc->y, crtc->width,
-                           crtc->height);
+                pixel = reply->pixel;
+                free(reply);
             }
             else
             {
-                bool changed = false;
+                failed = true;
+            }
+        }
 
-                /*
-                 * We know this monitor. Update information. If it's
-                 * smaller than before, rearrange windows.
-                 */
-                PDEBUG("Known monitor. Updating info.\n");
+        if (failed)
+        {
+            fprintf(stderr, "mcwm: Couldn't get pixel value for colour %s. "
+                    "Exiting.\n", cols[i].name);
 
-                if (crtc->x != mon->x)
-                {
-                    mon->x = crtc->x;
-                    changed = true;
-                }
-                if (crtc->y != mon->y)
-                {
-                    mon->y = crtc->y;
-                    changed = true;
-                }
+            xcb_disconnect(conn);
+            exit(1);
+        }
 
-                if (crtc->width != mon->width)
-                {
-                    mon->width = crtc->width;
-                    changed = true;
-                }
-                if (crtc->height != mon->height)
-                {
-                    mon->height = crtc->height;
-                    changed = true;
-                }
+        *cols[i].pixel = pixel;
+    }
+}
 
-                if (changed)
-                {
-                    arrbymon(mon);
-                }
-            }
-
-            free(crtc);
-        }
-        else
-        {
-            PDEBUG("Monitor not used at the moment.\n");
-            /*
-             * Check if it was used before. If it was, do something.
-             */
-            if ((mon = findmonitor(outputs[i])))
-            {
-                struct item *item;
-                struct client *client;
-
-                /* Check all windows on this monitor and move them to
-                 * the next or to the first monitor if there is no
-                 * next.
-                 *
-                 * FIXME: Use per monitor workspace list instead of
-                 * global window list.
-                 */
-                for (item = winlist; item != NULL; item = item->next)
-                {
-                    client = item->data;
-                    if (client->monitor == mon)
-                    {
-                        if (NULL == client->monitor->item->next)
-                        {
-                            if (NULL == monlist)
-                            {
-                                client->monitor = NULL;
-                            }
-                            else
-                            {
-                                client->monitor = monlist->data;
-                            }
-                        }
-                        else
-                        {
-                            client->monitor =
-                                client->monitor->item->next->data;
-                        }
-
-                        fitonscreen(client);
-                    }
-                }
-
-                /* It's not active anymore. Forget about it. */
-                delmonitor(mon);
-            }
-        }
-
-        free(output);
-    }
-}
-
-void arrbymon(struct monitor *monitor)
-{
-    struct item *item;
-    struct client *client;
-
-    PDEBUG("arrbymon\n");
-    /*
-     * Go through all windows on this monitor. If they don't fit on
-     * the new screen, move them around and resize them as necessary.
-     *
-     * FIXME: Use a per monitor workspace list instead of global
-     * windows list.
-     */
-    for (item = winlist; item != NULL; item = item->next)
-    {
-        client = item->data;
-        if (client->monitor == monitor)
-        {
-            fitonscreen(client);
-        }
-    }
-
-}
-
-struct monitor *findmonitor(xcb_randr_output_t id)
-{
-    struct item *item;
-    struct monitor *mon;
-
-    for (item = monlist; item != NULL; item = item->next)
-    {
-        mon = item->data;
-        if (id == mon->id)
-        {
-            PDEBUG("findmonitor: Found it. Output ID: %d\n", mon->id);
-            return mon;
-        }
-        PDEBUG("findmonitor: Goint to %p.\n", item->next);
-    }
-
-    return NULL;
-}
-
-struct monitor *findclones(xcb_randr_output_t id, int16_t x, int16_t y)
+/* Forget everything about client client. */
+void forgetclient(struct client *client)
 {
-    struct monitor *clonemon;
-    struct item *item;
-
-    for (item = monlist; item != NULL; item = item->next)
+    if (NULL == client)
     {
-        clonemon = item->data;
-
-        PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
-               clonemon->name,
-               clonemon->x, clonemon->x + clonemon->width,
-               clonemon->y, clonemon->y + clonemon->height);
-
-        /* Check for same position. */
-        if (id != clonemon->id && clonemon->x == x && clonemon->y == y)
-        {
-            return clonemon;
-        }
+        PDEBUG("forgetclient: client was NULL\n");
+        return;
     }
 
-    return NULL;
-}
-
-struct monitor *findmonbycoord(int16_t x, int16_t y)
-{
-    struct item *item;
-    struct monitor *mon;
-
-    for (item = monlist; item != NULL; item = item->next)
+    /* Delete this client from whatever workspace list it belongs to. */
+    if (NULL != client->wsitem)
     {
-        mon = item->data;
-
-        PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
-               mon->name,
-               mon->x, mon->x + mon->width,
-               mon->y, mon->y + mon->height);
-
-        PDEBUG("Is %d,%d between them?\n", x, y);
-
-        if (x >= mon->x && x <= mon->x + mon->width
-            && y >= mon->y && y <= mon->y + mon->height)
-        {
-            PDEBUG("findmonbycoord: Found it. Output ID: %d, name %s\n",
-                   mon->id, mon->name);
-            return mon;
-        }
+        delfromworkspace(client);
     }
 
-    return NULL;
-}
-
-void delmonitor(struct monitor *mon)
-{
-    PDEBUG("Deleting output %s.\n", mon->name);
-    free(mon->name);
-    freeitem(&monlist, NULL, mon->item);
-}
-
-struct monitor *addmonitor(xcb_randr_output_t id, char *name,
-                           uint32_t x, uint32_t y, uint16_t width,
-                           uint16_t height)
-{
-    struct item *item;
-    struct monitor *mon;
-
-    if (NULL == (item = additem(&monlist)))
+    if (NULL != client->monitem)
     {
-        fprintf(stderr, "Out of memory.\n");
-        return NULL;
+        delitem(&wssetof(client->monitor)->clients, client->monitem);
+        client->monitem = NULL;
     }
 
-    mon = malloc(sizeof (struct monitor));
-    if (NULL == mon)
+    /* The window is going away. Don't write to it. */
+    if (NULL != client->dirtyitem)
     {
-        fprintf(stderr, "Out of memory.\n");
-        return NULL;
+        delitem(&dirtylist, client->dirtyitem);
+        client->dirtyitem = NULL;
     }
 
-    item->data = mon;
-
-    mon->id = id;
-    mon->name = name;
-    mon->x = x;
-    mon->y = y;
-    mon->width = width;
-    mon->height = height;
-    mon->item = item;
-
-    return mon;
-}
-
-/* Raise window win to top of stack. */
-void raisewindow(xcb_drawable_t win)
-{
-    uint32_t values[] = { XCB_STACK_MODE_ABOVE };
-
-    if (screen->root == win || 0 == win)
-    {
-        return;
-    }
+    hashdel(&clienttab, client->id);
+    statedirty = true;
 
-    xcb_configure_window(conn, win,
-                         XCB_CONFIG_WINDOW_STACK_MODE,
-                         values);
-    xcb_flush(conn);
+    /* Remove from global window list. */
+    freeitem(&winlist, NULL, client->winitem);
 }
 
-/*
- * Set window client to either top or bottom of stack depending on
- * where it is now.
- */
-void raiseorlower(struct client *client)
+/* Forget everything about a client with client->id win. */
+void forgetwin(xcb_window_t win)
 {
-    uint32_t values[] = { XCB_STACK_MODE_OPPOSITE };
-    xcb_drawable_t win;
+    struct client *client;
 
+    /*
+     * Forget about it completely and free allocated data.
+     *
+     * Note that it might already be freed by handling an
+     * UnmapNotify, so it isn't necessarily an error if we don't
+     * find it.
+     */
+    client = findclient(win);
     if (NULL == client)
     {
+        PDEBUG("forgetwin: Didn't know about %d.\n", win);
         return;
     }
 
-    win = client->id;
+    PDEBUG("Found it. Forgetting...\n");
 
-    xcb_configure_window(conn, win,
-                         XCB_CONFIG_WINDOW_STACK_MODE,
-                         values);
-    xcb_flush(conn);
+    forgetclient(client);
 }
 
-void movelim(struct client *client)
+/*
+ * Fit client on physical screen, moving and resizing as necessary.
+ */
+void fitonscreen(struct client *client)
 {
     int16_t mon_x;
     int16_t mon_y;
     uint16_t mon_width;
     uint16_t mon_height;
+    bool willmove = false;
+    bool willresize = false;
+
+    if (client->vertmaxed)
+    {
+        client->vertmaxed = false;
+        statedirty = true;
+    }
+
+    if (client->maxed)
+    {
+        client->maxed = false;
+        setborders(client, conf.borderwidth);
+        statedirty = true;
+    }
 
     if (NULL == client->monitor)
     {
+        /*
+         * This window isn't attached to any physical monitor. This
+         * probably means there is no RANDR, so we use the root window
+         * size.
+         */
         mon_x = 0;
         mon_y = 0;
         mon_width = screen->width_in_pixels;
@@ -1880,1742 +2105,4373 @@ void movelim(struct client *client)
         mon_height = client->monitor->height;
     }
 
+    PDEBUG("Is window outside monitor?\n");
+    PDEBUG("x: %d between %d and %d?\n", client->x, mon_x, mon_x + mon_width);
+    PDEBUG("y: %d between %d and %d?\n", client->y, mon_y, mon_y + mon_height);
+
     /* Is it outside the physical monitor? */
+    if (client->x > mon_x + mon_width)
+    {
+        client->x = mon_x + mon_width - client->width;
+        willmove = true;
+    }
+    if (client->y > mon_y + mon_height)
+    {
+        client->y = mon_y + mon_height - client->height;
+        willmove = true;
+    }
+
     if (client->x < mon_x)
     {
         client->x = mon_x;
+        willmove = true;
     }
     if (client->y < mon_y)
     {
         client->y = mon_y;
+        willmove = true;
     }
 
-    if (client->x + client->width > mon_x + mon_width - conf.borderwidth * 2)
+    /* Is it smaller than it wants to  be? */
+    if (0 != client->min_height && client->height < client->min_height)
     {
-        client->x = (mon_x + mon_width - conf.borderwidth * 2) - client->width;
+        client->height = client->min_height;
+        willresize = true;
     }
 
-    if (client->y + client->height > mon_y + mon_height - conf.borderwidth * 2)
+    if (0 != client->min_width && client->width < client->min_width)
     {
-        client->y = (mon_y + mon_height - conf.borderwidth * 2)
-            - client->height;
+        client->width = client->min_width;
+        willresize = true;
     }
 
-    movewindow(client->id, client->x, client->y);
-}
-
-/* Move window win to root coordinates x,y. */
-void movewindow(xcb_drawable_t win, uint16_t x, uint16_t y)
-{
-    uint32_t values[2];
-
-    if (screen->root == win || 0 == win)
+    /*
+     * If the window is larger than our screen, just place it in the
+     * corner and resize.
+     */
+    if (client->width + conf.borderwidth * 2 > mon_width)
     {
-        /* Can't move root. */
-        return;
+        client->x = mon_x;
+        client->width = mon_width - conf.borderwidth * 2;;
+        willmove = true;
+        willresize = true;
+    }
+    else if (client->x + client->width + conf.borderwidth * 2
+             > mon_x + mon_width)
+    {
+        client->x = mon_x + mon_width - (client->width + conf.borderwidth * 2);
+        willmove = true;
     }
 
-    values[0] = x;
-    values[1] = y;
-
-    xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_X
-                         | XCB_CONFIG_WINDOW_Y, values);
-
-    xcb_flush(conn);
-}
-
-/* Change focus to next in window ring. */
-void focusnext(bool reverse)
-{
-    struct client *client = NULL;
+    if (client->height + conf.borderwidth * 2 > mon_height)
+    {
+        client->y = mon_y;
+        client->height = mon_height - conf.borderwidth * 2;
+        willmove = true;
+        willresize = true;
+    }
+    else if (client->y + client->height + conf.borderwidth * 2
+             > mon_y + mon_height)
+    {
+        client->y = mon_y + mon_height - (client->height + conf.borderwidth
+                                          * 2);
+        willmove = true;
+    }
 
-#if DEBUG
-    if (NULL != focuswin)
+    if (willmove)
     {
-        PDEBUG("Focus now in win %d\n", focuswin->id);
+        PDEBUG("Moving to %d,%d.\n", client->x, client->y);
+        movewindow(client->id, client->x, client->y);
     }
-#endif
 
-    if (NULL == wslist[curws])
+    if (willresize)
     {
-        PDEBUG("No windows to focus on in this workspace.\n");
-        return;
+        PDEBUG("Resizing to %d x %d.\n", client->width, client->height);
+        resize(client->id, client->width, client->height);
     }
+}
 
-    if (MCWM_TABBING != mode)
+/*
+ * Set position, geometry and attributes of a new window and show it
+ * on the screen.
+ */
+void newwin(xcb_window_t win)
+{
+    struct client *client;
+
+    if (NULL != findclient(win))
     {
         /*
-         * Remember what we last focused on. We need this when the
-         * MODKEY is released and we move the last focused window in
-         * the tabbing order list.
+         * We know this window from before. It's trying to map itself
+         * on the current workspace, but since it's unmapped it
+         * probably belongs on another workspace. We don't like that.
+         * Silently ignore.
          */
-        lastfocuswin = focuswin;
-        mode = MCWM_TABBING;
-
-        PDEBUG("Began tabbing.\n");
+        return;
     }
 
-    /* If we currently have no focus focus first in list. */
-    if (NULL == focuswin || NULL == focuswin->wsitem[curws])
+    /*
+     * Set up stuff, like borders, add the window to the client list,
+     * et cetera.
+     */
+    client = setupwin(win, xcb_get_geometry(conn, win),
+                      xcb_icccm_get_wm_normal_hints_unchecked(conn, win));
+    if (NULL == client)
     {
-        PDEBUG("Focusing first in list: %p\n", wslist[curws]);
-        client = wslist[curws]->data;
-
-        if (NULL != focuswin && NULL == focuswin->wsitem[curws])
-        {
-            PDEBUG("XXX Our focused window %d isn't on this workspace!\n",
-                   focuswin->id);
-        }
+        fprintf(stderr, "mcwm: Couldn't set up window. Out of memory.\n");
+        return;
     }
-    else
+
+    /*
+     * If the client doesn't say the user specified the coordinates
+     * for the window we put it in the best free space on the current
+     * workspace. If there is none, we map it where our pointer is
+     * instead.
+     */
+    if (!client->usercoord)
     {
-        if (reverse)
+        if (placewindow(client))
         {
-            if (NULL == focuswin->wsitem[curws]->prev)
-            {
-                /*
-                 * We were at the head of list. Focusing on last
-                 * window in list unless we were already there.
-                 */
-                struct item *last = wslist[curws];
-                while (NULL != last->next)
-                    last = last->next;
-                if (focuswin->wsitem[curws] != last->data)
-                {
-                    PDEBUG("Beginning of list. Focusing last in list: %p\n",
-                           last);
-                    client = last->data;
-                }
-            }
-            else
-            {
-                /* Otherwise, focus the next in list. */
-                PDEBUG("Tabbing. Focusing next: %p.\n",
-                       focuswin->wsitem[curws]->prev);
-                client = focuswin->wsitem[curws]->prev->data;
-            }
+            PDEBUG("Coordinates not set by user. Placing at %d,%d.\n",
+                   client->x, client->y);
         }
         else
         {
-            if (NULL == focuswin->wsitem[curws]->next)
-            {
-                /*
-                 * We were at the end of list. Focusing on first window in
-                 * list unless we were already there.
-                 */
-                if (focuswin->wsitem[curws] != wslist[curws]->data)
-                {
-                    PDEBUG("End of list. Focusing first in list: %p\n",
-                           wslist[curws]);
-                    client = wslist[curws]->data;
-                }
-            }
-            else
+            int16_t pointx;
+            int16_t pointy;
+
+            /* Get pointer position so we can move the window to the cursor. */
+            if (!getpointer(screen->root, &pointx, &pointy))
             {
-                /* Otherwise, focus the next in list. */
-                PDEBUG("Tabbing. Focusing next: %p.\n",
-                       focuswin->wsitem[curws]->next);
-                client = focuswin->wsitem[curws]->next->data;
+                PDEBUG("Failed to get pointer coords!\n");
+                pointx = 0;
+                pointy = 0;
             }
+
+            PDEBUG("Coordinates not set by user. Using pointer: %d,%d.\n",
+                   pointx, pointy);
+
+            client->x = pointx;
+            client->y = pointy;
         }
+
+        movewindow(client->id, client->x, client->y);
+    }
+    else
+    {
+        PDEBUG("User set coordinates.\n");
     }
 
-    if (NULL != client)
+    /* Find the physical output this window will be on if we know any. */
+    if (NULL != monlist)
     {
         /*
-         * Raise window if it's occluded, then warp pointer into it and
-         * set keyboard focus to it.
+         * If the window coordinates are outside all physical
+         * monitors, this is the closest monitor.
          */
-        uint32_t values[] = { XCB_STACK_MODE_TOP_IF };
-
-        xcb_configure_window(conn, client->id, XCB_CONFIG_WINDOW_STACK_MODE,
-                             values);
-        xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
-                         client->width / 2, client->height / 2);
-        setfocus(client);
+        setmonitor(client, findmonbycoord(client->x, client->y));
     }
-}
 
-/* Mark window win as unfocused. */
-void setunfocus(xcb_drawable_t win)
-{
-    uint32_t values[1];
+    /* Add this window to the current workspace on its monitor. */
+    addtoworkspace(client, wssetof(client->monitor)->curws);
 
-    if (NULL == focuswin)
-    {
-        return;
-    }
+    fitonscreen(client);
 
-    if (focuswin->id == screen->root)
-    {
-        return;
-    }
+    /* Show window on screen. */
+    xcb_map_window(conn, client->id);
 
-    /* Set new border colour. */
-    values[0] = conf.unfocuscol;
-    xcb_change_window_attributes(conn, win, XCB_CW_BORDER_PIXEL, values);
+    /* Declare window normal. */
+    long data[] = { XCB_ICCCM_WM_STATE_NORMAL, XCB_NONE };
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
+                              wm_state, wm_state, 32, 2, data);
 
-    xcb_flush(conn);
+    /*
+     * Move cursor into the middle of the window so we don't lose the
+     * pointer to another window.
+     */
+    xcb_warp_pointer(conn, XCB_NONE, win, 0, 0, 0, 0,
+                     client->width / 2, client->height / 2);
 }
 
 /*
- * Find client with client->id win in global window list.
- *
- * Returns client pointer or NULL if not found.
+ * Set border colour, width and event mask for window. The geometry
+ * and size hints are collected from geomcookie and hintscookie, which
+ * the caller has already sent so we don't wait for them one at a
+ * time.
  */
-struct client *findclient(xcb_drawable_t win)
+struct client *setupwin(xcb_window_t win,
+                        xcb_get_geometry_cookie_t geomcookie,
+                        xcb_get_property_cookie_t hintscookie)
 {
+    uint32_t mask = 0;
+    uint32_t values[2];
     struct item *item;
     struct client *client;
+    xcb_size_hints_t hints;
+    xcb_get_property_reply_t *hintsreply;
 
-    for (item = winlist; item != NULL; item = item->next)
-    {
-        client = item->data;
-        if (win == client->id)
-        {
-            PDEBUG("findclient: Found it. Win: %d\n", client->id);
-            return client;
-        }
-    }
-
-    return NULL;
-}
+    /* Set default border color. */
+    values[0] = conf.unfocuscol;
+    xcb_change_window_attributes(conn, win, XCB_CW_BORDER_PIXEL, values);
 
-/* Set focus on window client. */
-void setfocus(struct client *client)
-{
-    uint32_t values[1];
+    /* Subscribe to events we want to know about in this window. */
+    mask = XCB_CW_EVENT_MASK;
+    values[0] = XCB_EVENT_MASK_ENTER_WINDOW;
+    xcb_change_window_attributes_checked(conn, win, mask, values);
 
     /*
-     * If client is NULL, we focus on whatever the pointer is on.
-     *
-     * This is a pathological case, but it will make the poor user
-     * able to focus on windows anyway, even though this window
-     * manager might be buggy.
+     * Add this window to the X Save Set, that is, the windows that
+     * will be automatically restored if we die.
      */
-    if (NULL == client)
-    {
-        PDEBUG("setfocus: client was NULL!\n");
-
-        focuswin = NULL;
+    xcb_change_save_set(conn, XCB_SET_MODE_INSERT, win);
 
-        xcb_set_input_focus(conn, XCB_NONE, XCB_INPUT_FOCUS_POINTER_ROOT,
-                            XCB_CURRENT_TIME);
-        xcb_flush(conn);
+    /* Remember window and store a few things about it. */
 
-        return;
-    }
+    item = additem(&winlist);
 
-    /*
-     * Don't bother focusing on the root window or on the same window
-     * that already has focus.
-     */
-    if (client->id == screen->root || client == focuswin)
+    if (NULL == item)
     {
-        return;
+        PDEBUG("newwin: Out of memory.\n");
+        xcb_discard_reply(conn, geomcookie.sequence);
+        xcb_discard_reply(conn, hintscookie.sequence);
+        return NULL;
     }
 
-    /* Set new border colour. */
-    if (client->fixed)
-    {
-        values[0] = conf.fixedcol;
-    }
-    else
+    client = malloc(sizeof (struct client));
+    if (NULL == client)
     {
-        values[0] = conf.focuscol;
+        PDEBUG("newwin: Out of memory.\n");
+        delitem(&winlist, item);
+        xcb_discard_reply(conn, geomcookie.sequence);
+        xcb_discard_reply(conn, hintscookie.sequence);
+        return NULL;
     }
 
-    xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
-                                 values);
+    item->data = client;
 
-    /* Unset last focus. */
-    if (NULL != focuswin)
+    /* Initialize client. */
+    client->id = win;
+    client->usercoord = false;
+    client->x = 0;
+    client->y = 0;
+    client->width = 0;
+    client->height = 0;
+    client->min_width = 0;
+    client->min_height = 0;
+    client->max_width = screen->width_in_pixels;
+    client->max_height = screen->height_in_pixels;
+    client->base_width = 0;
+    client->base_height = 0;
+    client->width_inc = 1;
+    client->height_inc = 1;
+    client->vertmaxed = false;
+    client->maxed = false;
+    client->fixed = false;
+    client->monitor = NULL;
+    client->monitem = NULL;
+
+    client->winitem = item;
+
+    if (0 != hashadd(&clienttab, win, client))
     {
-        setunfocus(focuswin->id);
+        PDEBUG("newwin: Out of memory.\n");
+        free(client);
+        delitem(&winlist, item);
+        xcb_discard_reply(conn, geomcookie.sequence);
+        xcb_discard_reply(conn, hintscookie.sequence);
+        return NULL;
     }
 
-    /* Set new input focus. */
-
-    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, client->id,
-                        XCB_CURRENT_TIME);
+    client->ws = 0;
+    client->wsitem = NULL;
+    client->unmaps = 0;
+    client->desktop = MCWM_NOWS;
+    client->dirtyitem = NULL;
 
-    xcb_flush(conn);
+    /* No monitor until we know where it is. */
+    setmonitor(client, NULL);
 
-    /* Remember the new window as the current focused window. */
-    focuswin = client;
-}
+    PDEBUG("Adding window %d\n", client->id);
 
-int start(char *program)
-{
-    pid_t pid;
+    setborders(client, conf.borderwidth);
 
-    pid = fork();
-    if (-1 == pid)
+    /* Get window geometry. */
+    if (!getgeom(geomcookie, &client->x, &client->y, &client->width,
+                 &client->height))
     {
-        perror("fork");
-        return -1;
+        fprintf(stderr, "Couldn't get geometry in initial setup of window.\n");
     }
-    else if (0 == pid)
-    {
-        char *argv[2];
 
-        /* In the child. */
-
-        /*
-         * Make this process a new process leader, otherwise the
-         * terminal will die when the wm dies. Also, this makes any
-         * SIGCHLD go to this process when we fork again.
-         */
-        if (-1 == setsid())
-        {
-            perror("setsid");
-            exit(1);
-        }
-
-        argv[0] = program;
-        argv[1] = NULL;
-
-        if (-1 == execvp(program, argv))
-        {
-            perror("execve");
-            exit(1);
-        }
-        exit(0);
-    }
-
-    return 0;
-}
-
-/* Resize with limit. */
-void resizelim(struct client *client)
-{
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
-
-    if (NULL == client->monitor)
-    {
-        mon_x = 0;
-        mon_y = 0;
-        mon_width = screen->width_in_pixels;
-        mon_height = screen->height_in_pixels;
-    }
-    else
+    /*
+     * Get the window's incremental size step, if any.
+     */
+    hintsreply = waitreply(hintscookie.sequence, NULL);
+    if (NULL == hintsreply
+        || !xcb_icccm_get_wm_size_hints_from_reply(&hints, hintsreply))
     {
-        mon_x = client->monitor->x;
-        mon_y = client->monitor->y;
-        mon_width = client->monitor->width;
-        mon_height = client->monitor->height;
+        PDEBUG("Couldn't get size hints.\n");
+        hints.flags = 0;
     }
+    free(hintsreply);
 
-    /* Is it smaller than it wants to  be? */
-    if (0 != client->min_height && client->height < client->min_height)
+    /*
+     * The user specified the position coordinates. Remember that so
+     * we can use geometry later.
+     */
+    if (hints.flags & XCB_ICCCM_SIZE_HINT_US_POSITION)
     {
-        client->height = client->min_height;
+        client->usercoord = true;
     }
 
-    if (0 != client->min_width && client->width < client->min_width)
+    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE)
     {
-        client->width = client->min_width;
+        client->min_width = hints.min_width;
+        client->min_height = hints.min_height;
     }
 
-    if (client->x + client->width + conf.borderwidth * 2 > mon_x + mon_width)
+    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE)
     {
-        client->width = mon_width - ((client->x - mon_x) + conf.borderwidth
-                                     * 2);
-    }
 
-    if (client->y + client->height + conf.borderwidth * 2 > mon_y + mon_height)
-    {
-        client->height = mon_height - ((client->y - mon_y) + conf.borderwidth
-                                       * 2);
+        client->max_width = hints.max_width;
+        client->max_height = hints.max_height;
     }
 
-    resize(client->id, client->width, client->height);
-}
+    if (hints.flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC)
+    {
+        client->width_inc = hints.width_inc;
+        client->height_inc = hints.height_inc;
 
-void moveresize(xcb_drawable_t win, uint16_t x, uint16_t y,
-                uint16_t width, uint16_t height)
-{
-    uint32_t values[4];
+        PDEBUG("widht_inc %d\nheight_inc %d\n", client->width_inc,
+               client->height_inc);
+    }
 
-    if (screen->root == win || 0 == win)
+    if (hints.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE)
     {
-        /* Can't move or resize root. */
-        return;
+        client->base_width = hints.base_width;
+        client->base_height = hints.base_height;
     }
 
-    PDEBUG("Moving to %d, %d, resizing to %d x %d.\n", x, y, width, height);
-
-    values[0] = x;
-    values[1] = y;
-    values[2] = width;
-    values[3] = height;
-
-    xcb_configure_window(conn, win,
-                         XCB_CONFIG_WINDOW_X
-                         | XCB_CONFIG_WINDOW_Y
-                         | XCB_CONFIG_WINDOW_WIDTH
-                         | XCB_CONFIG_WINDOW_HEIGHT, values);
-    xcb_flush(conn);
+    return client;
 }
 
-/* Resize window win to width,height. */
-void resize(xcb_drawable_t win, uint16_t width, uint16_t height)
+/*
+ * Get a keycode from a keysym.
+ *
+ * Returns keycode value.
+ */
+xcb_keycode_t keysymtokeycode(xcb_keysym_t keysym, xcb_key_symbols_t *keysyms)
 {
-    uint32_t values[2];
+    xcb_keycode_t *keyp;
+    xcb_keycode_t key;
 
-    if (screen->root == win || 0 == win)
+    /* We only use the first keysymbol, even if there are more. */
+    keyp = xcb_key_symbols_get_keycode(keysyms, keysym);
+    if (NULL == keyp)
     {
-        /* Can't resize root. */
-        return;
+        fprintf(stderr, "mcwm: Couldn't look up key. Exiting.\n");
+        exit(1);
+        return 0;
     }
 
-    PDEBUG("Resizing to %d x %d.\n", width, height);
-
-    values[0] = width;
-    values[1] = height;
+    key = *keyp;
+    free(keyp);
 
-    xcb_configure_window(conn, win,
-                         XCB_CONFIG_WINDOW_WIDTH
-                         | XCB_CONFIG_WINDOW_HEIGHT, values);
-    xcb_flush(conn);
+    return key;
 }
 
 /*
- * Resize window client in direction direction. Direction is:
- *
- * h = left, that is decrease width.
- *
- * j = down, that is, increase height.
- *
- * k = up, that is, decrease height.
+ * Set up all shortcut keys.
  *
- * l = right, that is, increase width.
+ * Returns 0 on success, non-zero otherwise.
  */
-void resizestep(struct client *client, char direction)
+int setupkeys(void)
 {
-    int step_x = MOVE_STEP;
-    int step_y = MOVE_STEP;
+    xcb_key_symbols_t *keysyms;
+    unsigned i;
 
-    if (NULL == client)
-    {
-        return;
-    }
+    /* Get all the keysymbols. */
+    keysyms = xcb_key_symbols_alloc(conn);
 
-    if (client->maxed)
+    /*
+     * Find out what keys generates our MODKEY mask. Unfortunately it
+     * might be several keys.
+     */
+    if (NULL != modkeys.keycodes)
     {
-        /* Can't resize a fully maximized window. */
-        return;
+        free(modkeys.keycodes);
     }
+    modkeys = getmodkeys(MODKEY);
 
-    raisewindow(client->id);
-
-    if (client->width_inc > 1)
-    {
-        step_x = client->width_inc;
-    }
-    else
+    if (0 == modkeys.len)
     {
-        step_x = MOVE_STEP;
+        fprintf(stderr, "We couldn't find any keycodes to our main modifier "
+                "key!\n");
+        return -1;
     }
 
-    if (client->height_inc > 1)
-    {
-        step_y = client->height_inc;
-    }
-    else
+    for (i = 0; i < modkeys.len; i ++)
     {
-        step_y = MOVE_STEP;
+        /*
+         * Grab the keys that are bound to MODKEY mask with any other
+         * modifier.
+         */
+        xcb_grab_key(conn, 1, screen->root, XCB_MOD_MASK_ANY,
+                     modkeys.keycodes[i],
+                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
     }
 
-    switch (direction)
+    /* Now grab the rest of the keys with the MODKEY modifier. */
+    for (i = KEY_F; i < KEY_MAX; i ++)
     {
-    case 'h':
-        client->width = client->width - step_x;
-        break;
-
-    case 'j':
-        client->height = client->height + step_y;
-        break;
+        if (XK_VoidSymbol == keys[i].keysym)
+        {
+            keys[i].keycode = 0;
+            continue;
+        }
 
-    case 'k':
-        client->height = client->height - step_y;
-        break;
+        keys[i].keycode = keysymtokeycode(keys[i].keysym, keysyms);
+        if (0 == keys[i].keycode)
+        {
+            /* Couldn't set up keys! */
 
-    case 'l':
-        client->width = client->width + step_x;
-        break;
+            /* Get rid of key symbols. */
+            xcb_key_symbols_free(keysyms);
 
-    default:
-        PDEBUG("resizestep in unknown direction.\n");
-        break;
-    } /* switch direction */
+            return -1;
+        }
 
-    resizelim(client);
+        /* Grab other keys with a modifier mask. */
+        xcb_grab_key(conn, 1, screen->root, MODKEY, keys[i].keycode,
+                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
 
-    /* If this window was vertically maximized, remember that it isn't now. */
-    if (client->vertmaxed)
-    {
-        client->vertmaxed = false;
+        /*
+         * XXX Also grab it's shifted counterpart. A bit ugly here
+         * because we grab all of them not just the ones we want.
+         */
+        xcb_grab_key(conn, 1, screen->root, MODKEY | SHIFTMOD,
+                     keys[i].keycode,
+                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
     }
 
-    xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
-                     client->width / 2, client->height / 2);
+    /* Need this to take effect NOW! */
     xcb_flush(conn);
+
+    /* Get rid of the key symbols table. */
+    xcb_key_symbols_free(keysyms);
+
+    return 0;
 }
 
 /*
- * Try to snap to other windows and monitor border
+ * Walk through all existing windows and set them up.
+ *
+ * To keep startup fast even with lots of windows and a slow
+ * connection we first send every request we need for every child of
+ * the root and only then start collecting the replies. This way the
+ * number of round trips doesn't depend on the number of windows.
+ *
+ * Returns 0 on success.
  */
-static void snapwindow(struct client *client, int snap_mode)
+int setupscreen(void)
 {
-    struct item *item;
-    struct client *win;
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
+    xcb_query_tree_reply_t *reply;
+    xcb_query_pointer_reply_t *pointer;
+    int i;
+    int len;
+    int adopted = 0;
+    xcb_window_t *children;
+    xcb_get_window_attributes_reply_t *attr;
+    struct adoptcookies *cookies;
+    struct client *client;
+    uint32_t ws;
+    uint64_t start;
+    xcb_query_tree_cookie_t treecookie;
+    xcb_get_property_cookie_t statecookie;
+    xcb_get_property_reply_t *statereply;
+    struct hashtab statetab;
+    int known;
 
-    if (NULL == client->monitor)
+    start = getmsec();
+
+    /*
+     * Get all children and what an earlier mcwm left behind about
+     * them, in the same round trip.
+     */
+    treecookie = xcb_query_tree(conn, screen->root);
+    statecookie = xcb_get_property(conn, false, screen->root, atom_state,
+                                   XCB_ATOM_CARDINAL, 0, UINT32_MAX / 4);
+
+    reply = waitreply(treecookie.sequence, NULL);
+    if (NULL == reply)
     {
-        mon_x = 0;
-        mon_y = 0;
-        mon_width = screen->width_in_pixels;
-        mon_height = screen->height_in_pixels;
+        xcb_discard_reply(conn, statecookie.sequence);
+        return -1;
     }
-    else
+
+    known = readstate(statecookie, &statetab, &statereply);
+
+    len = xcb_query_tree_children_length(reply);
+    children = xcb_query_tree_children(reply);
+
+    cookies = calloc(len, sizeof (struct adoptcookies));
+    if (NULL == cookies && 0 != len)
     {
-        mon_x = client->monitor->x;
-        mon_y = client->monitor->y;
-        mon_width = client->monitor->width;
-        mon_height = client->monitor->height;
+        fprintf(stderr, "mcwm: Out of memory.\n");
+        if (0 != known)
+        {
+            hashfree(&statetab);
+        }
+        free(statereply);
+        free(reply);
+        return -1;
     }
+
     /*
-     * Go through all windows on current workspace.
+     * Ask for everything we need to know about all windows. We only
+     * need to ask for the workspace hint on windows we don't already
+     * know about.
      */
-    for (item = wslist[curws]; item != NULL; item = item->next)
+    for (i = 0; i < len; i ++)
     {
-        win = item->data;
+        cookies[i].attr = xcb_get_window_attributes(conn, children[i]);
+        cookies[i].geom = xcb_get_geometry(conn, children[i]);
+        cookies[i].hints = xcb_icccm_get_wm_normal_hints_unchecked(
+            conn, children[i]);
 
-        if (client == win)
+        cookies[i].state = NULL;
+        if (0 != known)
         {
-            continue;
+            cookies[i].state = hashfind(&statetab, children[i]);
         }
 
-        if (snap_mode == MCWM_MOVE)
+        if (NULL == cookies[i].state)
         {
-            if (abs((win->x +win->width) - client->x) < conf.snapmargin)
-            {
-                if (client->y + client->height > win->y
-                    && client->y < win->y + win->height)
-                {
-                    client->x = (win->x + win->width) + (2 * conf.borderwidth);
-                }
-            }
+            cookies[i].desktop = getwmdesktopcookie(children[i]);
+        }
+    }
 
-            if (abs((win->y +win->height) - client->y) < conf.snapmargin)
-            {
-                if (client->x + client->width >win->x
-                    && client->x < win->x + win->width)
-                {
-                    client->y = (win->y + win->height) + (2 * conf.borderwidth);
-                }
-            }
+    /*
+     * Set up all windows on this root. By the time the first reply is
+     * here, the rest have mostly arrived too.
+     */
+    for (i = 0; i < len; i ++)
+    {
+        attr = waitreply(cookies[i].attr.sequence, NULL);
 
-            if (abs((client->x + client->width) - win->x) < conf.snapmargin)
+        /*
+         * Don't set up or even bother windows in override redirect
+         * mode.
+         *
+         * This mode means they wouldn't have been reported to us
+         * with a MapRequest if we had been running, so in the
+         * normal case we wouldn't have seen them.
+         *
+         * Only handle visible windows.
+         */
+        if (NULL == attr || attr->override_redirect
+            || attr->map_state != XCB_MAP_STATE_VIEWABLE)
+        {
+            if (NULL == attr)
             {
-                if (client->y + client->height > win->y
-                    && client->y < win->y + win->height)
-                {
-                    client->x = (win->x - client->width)
-                        - (2 * conf.borderwidth);
-                }
+                fprintf(stderr, "Couldn't get attributes for window %d.",
+                        children[i]);
             }
 
-            if (abs((client->y + client->height) - win->y) < conf.snapmargin)
+            /* We won't need the rest of the answers. */
+            xcb_discard_reply(conn, cookies[i].geom.sequence);
+            xcb_discard_reply(conn, cookies[i].hints.sequence);
+            if (NULL == cookies[i].state)
             {
-                if (client->x + client->width >win->x
-                    && client->x < win->x + win->width)
-                {
-                    client->y = (win->y - client->height)
-                        - (2 * conf.borderwidth);
-                }
+                xcb_discard_reply(conn, cookies[i].desktop.sequence);
             }
+            free(attr);
+            continue;
+        }
+
+        free(attr);
 
-        } /* mcwm_move */
-        else if (snap_mode == MCWM_RESIZE)
+        client = setupwin(children[i], cookies[i].geom, cookies[i].hints);
+        if (NULL == client)
         {
-            if (abs((client->x + client->width) - win->x) < conf.snapmargin)
+            if (NULL == cookies[i].state)
             {
-                if (client->y + client->height > win->y
-                    && client->y < win->y + win->height)
-                {
-                    client->width = (win->x - client->x)
-                        - (2 * conf.borderwidth);
-                }
+                xcb_discard_reply(conn, cookies[i].desktop.sequence);
             }
+            continue;
+        }
 
-            if (abs((client->y + client->height) - win->y) < conf.snapmargin)
+        adopted ++;
+
+        /*
+         * Find the physical output this window will be on if we
+         * know any.
+         */
+        if (NULL != monlist)
+        {
+            struct monitor *mon;
+
+            PDEBUG("Looking for monitor on %d x %d.\n", client->x,
+                   client->y);
+            mon = findmonbycoord(client->x, client->y);
+            if (NULL != mon)
             {
-                if (client->x + client->width >win->x
-                    && client->x < win->x + win->width)
-                {
-                    client->height = (win->y - client->y)
-                        - (2 * conf.borderwidth);
-                }
+                PDEBUG("Found client on monitor %s.\n", mon->name);
             }
-        } /* mcwm_resize */
-    }
 
-    /* monitor border */
-    if (snap_mode == MCWM_MOVE) {
+            setmonitor(client, mon);
+        }
 
-        if (abs(client->x - mon_x) < conf.snapmargin)
+        /*
+         * Fit window on physical screen. A maximized window will be
+         * maximized again below.
+         */
+        if (NULL == cookies[i].state
+            || !(cookies[i].state->flags & STATE_MAXED))
         {
-            client->x = mon_x;
+            fitonscreen(client);
         }
 
-        if (abs(client->y - mon_y) < conf.snapmargin)
+        /*
+         * Check if we had this window before we restarted. If not,
+         * check if it has a workspace set already as a WM hint.
+         */
+        if (NULL != cookies[i].state)
         {
-            client->y = mon_y;
+            ws = cookies[i].state->ws;
         }
-
-        if (abs((client->x + client->width) - mon_width) < conf.snapmargin)
+        else
         {
-            client->x = (mon_width - client->width);
+            ws = getwmdesktop(children[i], cookies[i].desktop);
         }
+        client->desktop = ws;
 
-        if (abs((client->y + client->height) - mon_height) < conf.snapmargin)
+        if (ws == NET_WM_FIXED)
         {
-            client->y = (mon_height - client->height);
+            /* Make it visible on all workspaces. */
+            fixwindow(client, false);
         }
-    }
-    else if (snap_mode == MCWM_RESIZE)
-    {
-        if (abs((client->width + client->x) - mon_width) < conf.snapmargin)
+        else if (MCWM_NOWS != ws && ws < conf.workspaces)
         {
-            client->width = mon_width;
+            addtoworkspace(client, ws);
+            /* If it's not the current workspace on its monitor, hide it. */
+            if (!onworkspace(client))
+            {
+                unmapwin(client);
+            }
         }
-        if (abs((client->height + client->y) - mon_height) < conf.snapmargin)
+        else
         {
-            client->height = mon_height;
+            /*
+             * No workspace hint at all. Just add it to the current
+             * workspace on its monitor.
+             */
+            addtoworkspace(client, wssetof(client->monitor)->curws);
         }
-    }
-}
 
-/*
- * Move window win as a result of pointer motion to coordinates
- * rel_x,rel_y.
- */
-void mousemove(struct client *client, int rel_x, int rel_y)
-{
-    client->x = rel_x;
-    client->y = rel_y;
+        if (NULL != cookies[i].state)
+        {
+            restorestate(client, cookies[i].state);
+        }
+    }
 
-    if (conf.snapmargin > 0)
+    free(cookies);
+    if (0 != known)
     {
-        snapwindow(client, MCWM_MOVE);
+        hashfree(&statetab);
     }
+    free(statereply);
 
-    movelim(client);
-}
-
-void mouseresize(struct client *client, int rel_x, int rel_y)
-{
+    /* Forget windows that went away while we were gone. */
+    statedirty = true;
 
-    client->width = abs(rel_x - client->x);
-    client->height = abs(rel_y - client->y);
+    fprintf(stderr, "mcwm: Adopted %d of %d windows in %lu ms.\n",
+            adopted, len, (unsigned long) (getmsec() - start));
 
-    client->width -= (client->width - client->base_width) % client->width_inc;
-    client->height -= (client->height - client->base_height)
-        % client->height_inc;
+    changeworkspace(0);
 
-    PDEBUG("Trying to resize to %dx%d (%dx%d)\n", client->width, client->height,
-           (client->width - client->base_width) / client->width_inc,
-           (client->height - client->base_height) / client->height_inc);
+    /*
+     * Get pointer position so we can set focus on any window which
+     * might be under it.
+     */
+    pointer = waitreply(xcb_query_pointer(conn, screen->root).sequence,
+                        NULL);
 
-    if (conf.snapmargin > 0)
+    if (NULL == pointer)
     {
-        snapwindow(client, MCWM_RESIZE);
+        focuswin = NULL;
     }
+    else
+    {
+        setfocus(findclient(pointer->child));
 
-    resizelim(client);
+        /* Work on the monitor under the pointer until something has focus. */
+        if (NULL == focuswin && NULL != monlist)
+        {
+            curmon = findmonbycoord(pointer->root_x, pointer->root_y);
+        }
 
-    /* If this window was vertically maximized, remember that it isn't now. */
-    if (client->vertmaxed)
-    {
-        client->vertmaxed = false;
+        free(pointer);
     }
+
+    flushdesktops();
+    writestate();
+    xcb_flush(conn);
+
+    free(reply);
+
+    return 0;
 }
 
-void movestep(struct client *client, char direction)
+/*
+ * Set up RANDR extension. Get the extension base and subscribe to
+ * events.
+ */
+int setuprandr(void)
 {
-    int16_t start_x;
-    int16_t start_y;
+    const xcb_query_extension_reply_t *extension;
+    xcb_randr_query_version_cookie_t cookie;
+    xcb_randr_query_version_reply_t *version;
+    int base;
 
-    if (NULL == client)
+    extension = xcb_get_extension_data(conn, &xcb_randr_id);
+    if (!extension->present)
     {
-        return;
+        PDEBUG("No RANDR extension.\n");
+        return -1;
     }
 
-    if (client->maxed)
+    /*
+     * With RANDR 1.5 we can ask for all monitors at once instead of
+     * for every output and CRTC.
+     */
+    cookie = xcb_randr_query_version(conn, 1, 5);
+    version = waitreply(cookie.sequence, NULL);
+    if (NULL != version)
     {
-        /* We can't move a fully maximized window. */
-        return;
-    }
+        PDEBUG("RANDR version %d.%d.\n", version->major_version,
+               version->minor_version);
 
-    /* Save pointer position so we can warp pointer here later. */
-    if (!getpointer(client->id, &start_x, &start_y))
-    {
-        return;
+        randroutputs = version->major_version > 1
+            || (1 == version->major_version && version->minor_version >= 3);
+        randrmonitors = version->major_version > 1
+            || (1 == version->major_version && version->minor_version >= 5);
+        free(version);
     }
 
-    raisewindow(client->id);
-    switch (direction)
+    /* Older servers tell us the screen changed, but not about monitors. */
+    if (randroutputs)
     {
-    case 'h':
-        client->x = client->x - MOVE_STEP;
-        break;
-
-    case 'j':
-        client->y = client->y + MOVE_STEP;
-        break;
-
-    case 'k':
-        client->y = client->y - MOVE_STEP;
-        break;
-
-    case 'l':
-        client->x = client->x + MOVE_STEP;
-        break;
-
-    default:
-        PDEBUG("movestep: Moving in unknown direction.\n");
-        break;
-    } /* switch direction */
+        getrandr();
+    }
 
-    movelim(client);
+    base = extension->first_event;
+    PDEBUG("randrbase is %d.\n", base);
 
     /*
-     * If the pointer was inside the window to begin with, move
-     * pointer back to where it was, relative to the window.
+     * RANDR 1.5 reports new, removed or changed monitors as screen
+     * changes. Outputs and CRTCs coming and going are reported as
+     * resource changes as well.
      */
-    if (start_x > 0 - conf.borderwidth && start_x < client->width
-        + conf.borderwidth && start_y > 0 - conf.borderwidth && start_y
-        < client->height + conf.borderwidth)
+    if (randrmonitors)
     {
-        xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
-                         start_x, start_y);
-        xcb_flush(conn);
+        xcb_randr_select_input(conn, screen->root,
+                               XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_RESOURCE_CHANGE);
+    }
+    else if (randroutputs)
+    {
+        xcb_randr_select_input(conn, screen->root,
+                               XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE |
+                               XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY);
+    }
+    else
+    {
+        xcb_randr_select_input(conn, screen->root,
+                               XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
     }
-}
-
-void setborders(struct client *client, int width)
-{
-    uint32_t values[1];
-    uint32_t mask = 0;
-
-    values[0] = width;
 
-    mask |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
-    xcb_configure_window(conn, client->id, mask, &values[0]);
     xcb_flush(conn);
+
+    return base;
 }
 
-void unmax(struct client *client)
+/*
+ * Find out what monitors we have. Ask for RANDR 1.5 monitors if we
+ * can, otherwise get RANDR resources and figure out how many outputs
+ * there are.
+ *
+ * Monitors are known by name atom on one path and by output on the
+ * other, so we stay on the path we started on. If we can't get RANDR
+ * 1.5 monitors before we have any, we use outputs from then on.
+ */
+void getrandr(void)
 {
-    uint32_t values[5];
-    uint32_t mask = 0;
+    xcb_randr_get_screen_resources_current_cookie_t rcookie;
+    xcb_randr_get_screen_resources_current_reply_t *res;
+    xcb_randr_output_t *outputs;
+    int len;
+    xcb_timestamp_t timestamp;
 
-    if (NULL == client)
+    if (randrmonitors)
     {
-        PDEBUG("unmax: client was NULL!\n");
+        if (0 == getmonitors())
+        {
+            return;
+        }
+
+        if (NULL != monlist)
+        {
+            PDEBUG("Keeping the monitors we have.\n");
+            return;
+        }
+
+        randrmonitors = false;
+    }
+
+    rcookie = xcb_randr_get_screen_resources_current(conn, screen->root);
+    res = waitreply(rcookie.sequence, NULL);
+    if (NULL == res)
+    {
+        printf("No RANDR extension available.\n");
         return;
     }
+    timestamp = res->config_timestamp;
 
-    client->x = client->origsize.x;
-    client->y = client->origsize.y;
-    client->width = client->origsize.width;
-    client->height = client->origsize.height;
+    len = xcb_randr_get_screen_resources_current_outputs_length(res);
+    outputs = xcb_randr_get_screen_resources_current_outputs(res);
 
-    /* Restore geometry. */
-    if (client->maxed)
+    PDEBUG("Found %d outputs.\n", len);
+
+    /* Request information for all outputs, if there are any. */
+    if (0 != len)
     {
-        values[0] = client->x;
-        values[1] = client->y;
-        values[2] = client->width;
-        values[3] = client->height;
+        getoutputs(outputs, len, timestamp);
+    }
 
-        /* Set borders again. */
-        values[4] = conf.borderwidth;
+    free(res);
+}
 
-        mask =
-            XCB_CONFIG_WINDOW_X
-            | XCB_CONFIG_WINDOW_Y
-            | XCB_CONFIG_WINDOW_WIDTH
-            | XCB_CONFIG_WINDOW_HEIGHT
-            | XCB_CONFIG_WINDOW_BORDER_WIDTH;
-    }
-    else
+/*
+ * The screen changed: a monitor came or went, or the root got a new
+ * geometry. Docking a laptop sends a burst of these, so we wait until
+ * nothing has changed for conf.settle ms and then rescan the monitors
+ * and fit the windows only once, on the final layout.
+ */
+void screenchanged(void)
+{
+    if (0 == conf.settle)
     {
-        values[0] = client->y;
-        values[1] = client->width;
-        values[2] = client->height;
-
-        mask = XCB_CONFIG_WINDOW_Y
-            | XCB_CONFIG_WINDOW_WIDTH
-            | XCB_CONFIG_WINDOW_HEIGHT;
+        screensettled();
+        return;
     }
 
-    xcb_configure_window(conn, client->id, mask, values);
-
-    /* Warp pointer to window or we might lose it. */
-    xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
-                     client->width / 2, client->height / 2);
+    if (NULL != settletimer.item)
+    {
+        /* The rescan we had waiting isn't needed anymore. */
+        norescans ++;
+    }
 
-    xcb_flush(conn);
+    settimer(&settletimer, conf.settle);
 }
 
-void maximize(struct client *client)
+/*
+ * Called when the screen has stopped changing. Find out what the
+ * monitors look like now and move windows to be visible.
+ */
+void screensettled(void)
 {
-    uint32_t values[4];
-    uint32_t mask = 0;
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
+    PDEBUG("Screen changes settled. Rescanning monitors.\n");
 
-    if (NULL == client)
+    rescans ++;
+
+    if (xinerama)
     {
-        PDEBUG("maximize: client was NULL!\n");
-        return;
+        getxinerama();
     }
-
-    if (NULL == client->monitor)
+    else if (-1 != randrbase)
     {
-        mon_x = 0;
-        mon_y = 0;
-        mon_width = screen->width_in_pixels;
-        mon_height = screen->height_in_pixels;
+        getrandr();
     }
     else
     {
-        mon_x = client->monitor->x;
-        mon_y = client->monitor->y;
-        mon_width = client->monitor->width;
-        mon_height = client->monitor->height;
+        /* No monitors. Just fit everything on the root. */
+        arrangewindows();
+    }
+}
+
+/*
+ * Walk through all the RANDR outputs (number of outputs == len) there
+ * was at time timestamp.
+ *
+ * We ask for everything about all outputs and their CRTCs before we
+ * wait for any of it, then let updatemonitors() change all monitors
+ * at once.
+ */
+void getoutputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp)
+{
+    xcb_randr_get_output_info_cookie_t ocookie[len];
+    xcb_randr_get_output_info_reply_t *output[len];
+    xcb_randr_get_crtc_info_cookie_t icookie[len];
+    xcb_randr_get_crtc_info_reply_t *crtc[len];
+    struct head heads[len];
+    struct monitor *mon;
+    int nheads = 0;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        ocookie[i] = xcb_randr_get_output_info(conn, outputs[i], timestamp);
     }
 
     /*
-     * Check if maximized already. If so, revert to stored
-     * geometry.
+     * Ask for the CRTC of every output in use as soon as we know it.
+     * We mostly wait only for the first output reply and the first
+     * CRTC reply.
      */
-    if (client->maxed)
+    for (i = 0; i < len; i ++)
     {
-        unmax(client);
-        client->maxed = false;
-        return;
+        output[i] = waitreply(ocookie[i].sequence, NULL);
+        if (NULL != output[i] && XCB_NONE != output[i]->crtc)
+        {
+            icookie[i] = xcb_randr_get_crtc_info(conn, output[i]->crtc,
+                                                 timestamp);
+        }
     }
 
-    /* Raise first. Pretty silly to maximize below something else. */
-    raisewindow(client->id);
+    for (i = 0; i < len; i ++)
+    {
+        crtc[i] = NULL;
 
-    /* FIXME: Store original geom in property as well? */
-    client->origsize.x = client->x;
-    client->origsize.y = client->y;
-    client->origsize.width = client->width;
-    client->origsize.height = client->height;
+        if (NULL != output[i] && XCB_NONE != output[i]->crtc)
+        {
+            crtc[i] = waitreply(icookie[i].sequence, NULL);
+        }
 
-    /* Remove borders. */
-    values[0] = 0;
-    mask = XCB_CONFIG_WINDOW_BORDER_WIDTH;
-    xcb_configure_window(conn, client->id, mask, values);
+        if (NULL != output[i] && XCB_NONE == output[i]->crtc)
+        {
+            /* Not in use. */
+            continue;
+        }
 
-    /* Move to top left and resize. */
-    client->x = mon_x;
-    client->y = mon_y;
-    client->width = mon_width;
-    client->height = mon_height;
+        if (NULL == crtc[i])
+        {
+            /*
+             * Leave a monitor we know alone by reporting it as it
+             * was. We'll know more next time.
+             */
+            mon = findmonitor(outputs[i]);
+            if (NULL != mon)
+            {
+                heads[nheads].id = outputs[i];
+                heads[nheads].name = mon->name;
+                heads[nheads].namelen = strlen(mon->name);
+                heads[nheads].x = mon->x;
+                heads[nheads].y = mon->y;
+                heads[nheads].width = mon->width;
+                heads[nheads].height = mon->height;
+                nheads ++;
+            }
+            continue;
+        }
 
-    values[0] = client->x;
-    values[1] = client->y;
-    values[2] = client->width;
-    values[3] = client->height;
-    xcb_configure_window(conn, client->id, XCB_CONFIG_WINDOW_X
-                         | XCB_CONFIG_WINDOW_Y
-                         | XCB_CONFIG_WINDOW_WIDTH
-                         | XCB_CONFIG_WINDOW_HEIGHT, values);
+        PDEBUG("Output %d: CRTC at %d, %d, size: %d x %d.\n",
+               outputs[i], crtc[i]->x, crtc[i]->y, crtc[i]->width,
+               crtc[i]->height);
 
-    xcb_flush(conn);
+        heads[nheads].id = outputs[i];
+        heads[nheads].name = (char *) xcb_randr_get_output_info_name(output[i]);
+        heads[nheads].namelen = xcb_randr_get_output_info_name_length(
+            output[i]);
+        heads[nheads].x = crtc[i]->x;
+        heads[nheads].y = crtc[i]->y;
+        heads[nheads].width = crtc[i]->width;
+        heads[nheads].height = crtc[i]->height;
+        nheads ++;
+    }
 
-    client->maxed = true;
+    updatemonitors(heads, nheads);
+
+    for (i = 0; i < len; i ++)
+    {
+        free(crtc[i]);
+        free(output[i]);
+    }
 }
 
-void maxvert(struct client *client)
+/*
+ * Ask for the RANDR 1.5 monitors in use. The server has already
+ * merged clones and tiled displays into one monitor each, so all we
+ * need is one reply.
+ *
+ * Returns 0 on success, -1 if we have to ask for outputs instead.
+ */
+int getmonitors(void)
 {
-    uint32_t values[2];
-    int16_t mon_y;
-    uint16_t mon_height;
+    xcb_randr_get_monitors_cookie_t cookie;
+    xcb_randr_get_monitors_reply_t *reply;
 
-    if (NULL == client)
+    cookie = xcb_randr_get_monitors(conn, screen->root, 1);
+    reply = waitreply(cookie.sequence, NULL);
+    if (NULL == reply)
     {
-        PDEBUG("maxvert: client was NULL\n");
-        return;
+        PDEBUG("Couldn't get RANDR monitors.\n");
+        return -1;
     }
 
-    if (NULL == client->monitor)
-    {
-        mon_y = 0;
-        mon_height = screen->height_in_pixels;
-    }
-    else
-    {
-        mon_y = client->monitor->y;
-        mon_height = client->monitor->height;
-    }
+    PDEBUG("Found %d monitors.\n", reply->nMonitors);
 
     /*
-     * Check if maximized already. If so, revert to stored geometry.
+     * No monitors at all is as good as no answer. It would also leave
+     * usemonitors() with zero-length arrays.
      */
-    if (client->vertmaxed)
+    if (0 == reply->nMonitors)
     {
-        unmax(client);
-        client->vertmaxed = false;
-        return;
+        free(reply);
+        return -1;
     }
 
-    /* Raise first. Pretty silly to maximize below something else. */
-    raisewindow(client->id);
-
-    /*
-     * Store original coordinates and geometry.
-     * FIXME: Store in property as well?
-     */
-    client->origsize.x = client->x;
-    client->origsize.y = client->y;
-    client->origsize.width = client->width;
-    client->origsize.height = client->height;
-
-    client->y = mon_y;
-    /* Compute new height considering height increments and screen height. */
-    client->height = mon_height - conf.borderwidth * 2;
-    client->height -= (client->height - client->base_height)
-        % client->height_inc;
-
-    /* Move to top of screen and resize. */
-    values[0] = client->y;
-    values[1] = client->height;
-
-    xcb_configure_window(conn, client->id, XCB_CONFIG_WINDOW_Y
-                         | XCB_CONFIG_WINDOW_HEIGHT, values);
-    xcb_flush(conn);
-
-    /* Remember that this client is vertically maximized. */
-    client->vertmaxed = true;
-}
+    usemonitors(reply);
 
-void hide(struct client *client)
-{
-    long data[] = { XCB_ICCCM_WM_STATE_ICONIC, XCB_NONE };
+    free(reply);
 
-    /*
-     * Unmap window and declare iconic.
-     *
-     * Unmapping will generate an UnmapNotify event so we can forget
-     * about the window later.
-     */
-    xcb_unmap_window(conn, client->id);
-    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
-                        wm_state, wm_state, 32, 2, data);
-    xcb_flush(conn);
+    return 0;
 }
 
-bool getpointer(xcb_drawable_t win, int16_t *x, int16_t *y)
+/*
+ * Walk through all RANDR 1.5 monitors in reply and make them our
+ * monitors.
+ */
+void usemonitors(xcb_randr_get_monitors_reply_t *reply)
 {
-    xcb_query_pointer_reply_t *pointer;
+    xcb_randr_monitor_info_iterator_t iter;
+    xcb_randr_monitor_info_t *info;
+    xcb_get_atom_name_cookie_t ncookie[reply->nMonitors];
+    xcb_get_atom_name_reply_t *names[reply->nMonitors];
+    char fallback[reply->nMonitors][sizeof "Monitor-4294967295"];
+    struct head heads[reply->nMonitors];
+    struct monitor *mon;
+    int nheads = 0;
+    int i;
 
-    pointer
-        = xcb_query_pointer_reply(conn, xcb_query_pointer(conn, win), 0);
-    if (NULL == pointer)
+    for (iter = xcb_randr_get_monitors_monitors_iterator(reply);
+         iter.rem > 0 && nheads < (int) reply->nMonitors;
+         xcb_randr_monitor_info_next(&iter))
     {
-        return false;
-    }
+        info = iter.data;
 
-    *x = pointer->win_x;
-    *y = pointer->win_y;
+        PDEBUG("Monitor %d: at %d, %d, size: %d x %d.\n", info->name,
+               info->x, info->y, info->width, info->height);
 
-    free(pointer);
+        heads[nheads].id = info->name;
+        heads[nheads].x = info->x;
+        heads[nheads].y = info->y;
+        heads[nheads].width = info->width;
+        heads[nheads].height = info->height;
+        names[nheads] = NULL;
 
-    return true;
-}
+        /*
+         * A monitor is known by its name atom. We only need the name
+         * itself for monitors we haven't seen before.
+         */
+        mon = findmonitor(info->name);
+        if (NULL != mon)
+        {
+            heads[nheads].name = mon->name;
+            heads[nheads].namelen = strlen(mon->name);
+        }
+        else
+        {
+            heads[nheads].name = NULL;
+            heads[nheads].namelen = 0;
+            ncookie[nheads] = xcb_get_atom_name(conn, info->name);
+        }
 
-bool getgeom(xcb_drawable_t win, int16_t *x, int16_t *y, uint16_t *width,
-             uint16_t *height)
-{
-    xcb_get_geometry_reply_t *geom;
+        nheads ++;
+    }
 
-    geom
-        = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, win), NULL);
-    if (NULL == geom)
+    for (i = 0; i < nheads; i ++)
     {
-        return false;
-    }
-
-    *x = geom->x;
-    *y = geom->y;
-    *width = geom->width;
-    *height = geom->height;
-
-    free(geom);
-
-    return true;
-}
+        if (NULL != heads[i].name)
+        {
+            continue;
+        }
 
-void topleft(void)
-{
-    int16_t pointx;
-    int16_t pointy;
-    int16_t mon_x;
-    int16_t mon_y;
 
-    if (NULL == focuswin)
-    {
-        return;
+        names[i] = waitreply(ncookie[i].sequence, NULL);
+        if (NULL != names[i])
+        {
+            heads[i].name = xcb_get_atom_name_name(names[i]);
+            heads[i].namelen = xcb_get_atom_name_name_length(names[i]);
+        }
+        else
+        {
+            /* Without its name we call it by its atom. */
+            heads[i].name = fallback[i];
+            heads[i].namelen = snprintf(fallback[i], sizeof fallback[i],
+                                        "Monitor-%u",
+                                        (unsigned) heads[i].id);
+        }
     }
 
-    if (NULL == focuswin->monitor)
-    {
-        mon_x = 0;
-        mon_y = 0;
-    }
-    else
+    updatemonitors(heads, nheads);
+
+    for (i = 0; i < nheads; i ++)
     {
-        mon_x = focuswin->monitor->x;
-        mon_y = focuswin->monitor->y;
+        free(names[i]);
     }
+}
 
-    raisewindow(focuswin->id);
+/*
+ * Find the head in heads (number of heads == num) that is monitor mon
+ * and still in use.
+ *
+ * Returns index in heads or -1 if mon isn't in use anymore.
+ */
+int findhead(struct monitor *mon, struct monitor **known, const bool *used,
+             int num)
+{
+    int i;
 
-    if (!getpointer(focuswin->id, &pointx, &pointy))
+    for (i = 0; i < num; i ++)
     {
-        return;
+        if (used[i] && known[i] == mon)
+        {
+            return i;
+        }
     }
 
-    focuswin->x = mon_x;
-    focuswin->y = mon_y;
-    movewindow(focuswin->id, focuswin->x, focuswin->y);
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     pointx, pointy);
-    xcb_flush(conn);
+    return -1;
 }
 
-void topright(void)
+/*
+ * Make the monitors we know about the same as the monitors in heads
+ * (number of heads == num), no matter where they came from. Update
+ * the ones we know, add new ones and forget the ones not in heads,
+ * moving their windows to a monitor still there. Then fit the windows
+ * on the monitors that changed, each window only once.
+ */
+void updatemonitors(struct head *heads, int num)
 {
-    int16_t pointx;
-    int16_t pointy;
-    int16_t mon_x;
-    uint16_t mon_y;
-    uint16_t mon_width;
+    char *name;
+    struct monitor *known[num];
+    bool used[num];
+    bool refit[num];
+    struct monitor *mon;
+    struct monitor *target;
+    struct client *client;
+    struct item *item;
+    struct item *next;
+    struct item *look;
+    bool changed;
+    bool clone;
+    int pass;
+    int i;
+    int j;
 
-    if (NULL == focuswin)
+    for (i = 0; i < num; i ++)
     {
-        return;
+        known[i] = findmonitor(heads[i].id);
+        used[i] = false;
+        refit[i] = false;
     }
 
-    if (NULL == focuswin->monitor)
+    /*
+     * Update the monitors we know about first, so a head cloning one
+     * of them doesn't replace it, then add new ones. A head at the
+     * same position as one we already handled is a clone.
+     */
+    for (pass = 0; pass < 2; pass ++)
     {
-        mon_width = screen->width_in_pixels;
-        mon_x = 0;
-        mon_y = 0;
+        for (i = 0; i < num; i ++)
+        {
+            if ((0 == pass) != (NULL != known[i]))
+            {
+                continue;
+            }
+
+            clone = false;
+            for (j = 0; j < num; j ++)
+            {
+                if (used[j] && heads[j].x == heads[i].x
+                    && heads[j].y == heads[i].y)
+                {
+                    clone = true;
+                    break;
+                }
+            }
+
+            if (clone)
+            {
+                PDEBUG("Monitor %d is a clone of monitor %d. Skipping.\n",
+                       heads[i].id, heads[j].id);
+                continue;
+            }
+
+            mon = known[i];
+            if (NULL == mon)
+            {
+                PDEBUG("Monitor not known, adding to list.\n");
+
+                if (-1 == asprintf(&name, "%.*s", heads[i].namelen,
+                                   heads[i].name))
+                {
+                    continue;
+                }
+
+                known[i] = addmonitor(heads[i].id, name, heads[i].x,
+                                      heads[i].y, heads[i].width,
+                                      heads[i].height);
+                if (NULL == known[i])
+                {
+                    free(name);
+                    continue;
+                }
+
+                used[i] = true;
+                continue;
+            }
+
+            /*
+             * We know this monitor. Update information. If it
+             * changed, rearrange windows later.
+             */
+            PDEBUG("Known monitor. Updating info.\n");
+
+            used[i] = true;
+
+            changed = heads[i].x != mon->x || heads[i].y != mon->y
+                || heads[i].width != mon->width
+                || heads[i].height != mon->height;
+
+            mon->x = heads[i].x;
+            mon->y = heads[i].y;
+            mon->width = heads[i].width;
+            mon->height = heads[i].height;
+
+            if (changed)
+            {
+                stalespace(&mon->wsset);
+                refit[i] = true;
+            }
+        }
     }
-    else
+
+    /* Monitors we knew about that aren't in use anymore. */
+    for (item = monlist; item != NULL; item = next)
     {
-        mon_width = focuswin->monitor->width;
-        mon_x = focuswin->monitor->x;
-        mon_y = focuswin->monitor->y;
+        next = item->next;
+        mon = item->data;
+
+        if (-1 != findhead(mon, known, used, num))
+        {
+            continue;
+        }
+
+        PDEBUG("Monitor %s not used at the moment.\n", mon->name);
+
+        /*
+         * Move all windows on this monitor to the next monitor still
+         * in use, or to the first one if there is no next.
+         */
+        target = NULL;
+        for (look = next; NULL != look && NULL == target;
+             look = look->next)
+        {
+            if (-1 != findhead(look->data, known, used, num))
+            {
+                target = look->data;
+            }
+        }
+
+        for (look = monlist; NULL != look && NULL == target;
+             look = look->next)
+        {
+            if (-1 != findhead(look->data, known, used, num))
+            {
+                target = look->data;
+            }
+        }
+
+        if (NULL != mon->wsset.clients)
+        {
+            while (NULL != mon->wsset.clients)
+            {
+                client = mon->wsset.clients->data;
+                setmonitor(client, target);
+                if (NULL == target)
+                {
+                    fitonscreen(client);
+                }
+            }
+
+            if (NULL != target)
+            {
+                refit[findhead(target, known, used, num)] = true;
+                stalespace(&target->wsset);
+            }
+        }
+
+        if (curmon == mon)
+        {
+            curmon = target;
+        }
+
+        /* It's not active anymore. Forget about it. */
+        delmonitor(mon);
     }
 
-    raisewindow(focuswin->id);
+    buildmontab();
 
-    if (!getpointer(focuswin->id, &pointx, &pointy))
+    /* Now fit the windows on every monitor that changed, once. */
+    for (i = 0; i < num; i ++)
     {
-        return;
+        if (refit[i])
+        {
+            arrbymon(known[i]);
+        }
     }
+}
 
-    focuswin->x = mon_x + mon_width -
-        (focuswin->width + conf.borderwidth * 2);
+/*
+ * Set up Xinerama. Only used when RANDR didn't tell us about any
+ * monitors.
+ *
+ * Returns true if Xinerama is active and told us about monitors.
+ */
+bool setupxinerama(void)
+{
+    const xcb_query_extension_reply_t *extension;
 
-    focuswin->y = mon_y;
+    extension = xcb_get_extension_data(conn, &xcb_xinerama_id);
+    if (!extension->present)
+    {
+        PDEBUG("No Xinerama extension.\n");
+        return false;
+    }
 
-    movewindow(focuswin->id, focuswin->x, focuswin->y);
+    getxinerama();
 
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     pointx, pointy);
-    xcb_flush(conn);
+    return NULL != monlist;
 }
 
-void botleft(void)
+/*
+ * Ask Xinerama for all screens, that is monitors, at once. Xinerama
+ * has no events of its own. We ask again when the root changes
+ * geometry.
+ */
+void getxinerama(void)
 {
-    int16_t pointx;
-    int16_t pointy;
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_height;
+    xcb_xinerama_query_screens_cookie_t cookie;
+    xcb_xinerama_query_screens_reply_t *reply;
 
-    if (NULL == focuswin)
+    cookie = xcb_xinerama_query_screens(conn);
+    reply = waitreply(cookie.sequence, NULL);
+    if (NULL == reply)
     {
+        PDEBUG("Couldn't get Xinerama screens.\n");
         return;
     }
 
-    if (NULL == focuswin->monitor)
+    /* Xinerama might be there but not active. */
+    if (0 == xcb_xinerama_query_screens_screen_info_length(reply))
     {
-        mon_x = 0;
-        mon_y = 0;
-        mon_height = screen->height_in_pixels;
+        PDEBUG("No Xinerama screens.\n");
+        free(reply);
+        return;
     }
-    else
+
+    usexinerama(reply);
+
+    free(reply);
+}
+
+/*
+ * Walk through all Xinerama screens in reply and make them our
+ * monitors. Xinerama doesn't name its screens, so we call them by
+ * number.
+ */
+void usexinerama(xcb_xinerama_query_screens_reply_t *reply)
+{
+    int len;
+    xcb_xinerama_screen_info_t *info;
+    char names[xcb_xinerama_query_screens_screen_info_length(reply)][16];
+    struct head heads[xcb_xinerama_query_screens_screen_info_length(reply)];
+    int i;
+
+    len = xcb_xinerama_query_screens_screen_info_length(reply);
+    info = xcb_xinerama_query_screens_screen_info(reply);
+
+    PDEBUG("Found %d Xinerama screens.\n", len);
+
+    for (i = 0; i < len; i ++)
     {
-        mon_x = focuswin->monitor->x;
-        mon_y = focuswin->monitor->y;
-        mon_height = focuswin->monitor->height;
+        PDEBUG("Xinerama screen %d: at %d, %d, size: %d x %d.\n", i,
+               info[i].x_org, info[i].y_org, info[i].width, info[i].height);
+
+        heads[i].id = i;
+        heads[i].name = names[i];
+        heads[i].namelen = snprintf(names[i], sizeof names[i],
+                                    "Xinerama-%d", i);
+        heads[i].x = info[i].x_org;
+        heads[i].y = info[i].y_org;
+        heads[i].width = info[i].width;
+        heads[i].height = info[i].height;
     }
 
-    raisewindow(focuswin->id);
+    updatemonitors(heads, len);
+}
 
-    if (!getpointer(focuswin->id, &pointx, &pointy))
+void arrbymon(struct monitor *monitor)
+{
+    struct item *item;
+    struct client *client;
+
+    PDEBUG("arrbymon\n");
+    /*
+     * Go through all windows on this monitor. If they don't fit on
+     * the new screen, move them around and resize them as necessary.
+     */
+    for (item = monitor->wsset.clients; item != NULL; item = item->next)
     {
-        return;
+        client = item->data;
+        fitonscreen(client);
     }
 
-    focuswin->x = mon_x;
-    focuswin->y = mon_y + mon_height - (focuswin->height + conf.borderwidth
-                                        * 2);
-    movewindow(focuswin->id, focuswin->x, focuswin->y);
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     pointx, pointy);
-    xcb_flush(conn);
 }
 
-void botright(void)
+/*
+ * Copy position and size of all monitors to montab. Call whenever a
+ * monitor is added, removed or changes geometry.
+ */
+void buildmontab(void)
 {
-    int16_t pointx;
-    int16_t pointy;
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
+    struct item *item;
+    struct monitor *mon;
+    struct monrect *rects;
+    int num = 0;
 
-    if (NULL == focuswin)
+    for (item = monlist; item != NULL; item = item->next)
     {
-        return;
+        num ++;
     }
 
-    if (NULL == focuswin->monitor)
+    if (num > montab.size)
     {
-        mon_x = 0;
-        mon_y = 0;
-        mon_width = screen->width_in_pixels;;
-        mon_height = screen->height_in_pixels;
+        rects = realloc(montab.rects, num * sizeof (struct monrect));
+        if (NULL == rects)
+        {
+            fprintf(stderr, "mcwm: Out of memory.\n");
+            montab.num = 0;
+            return;
+        }
+
+        montab.rects = rects;
+        montab.size = num;
     }
-    else
+
+    for (item = monlist, num = 0; item != NULL; item = item->next, num ++)
     {
-        mon_x = focuswin->monitor->x;
-        mon_y = focuswin->monitor->y;
-        mon_width = focuswin->monitor->width;
-        mon_height = focuswin->monitor->height;
+        mon = item->data;
+
+        montab.rects[num].x = mon->x;
+        montab.rects[num].y = mon->y;
+        montab.rects[num].width = mon->width;
+        montab.rects[num].height = mon->height;
+        montab.rects[num].id = mon->id;
+        montab.rects[num].mon = mon;
     }
 
-    raisewindow(focuswin->id);
+    montab.num = num;
+    montab.last = 0;
+}
 
-    if (!getpointer(focuswin->id, &pointx, &pointy))
+struct monitor *findmonitor(xcb_randr_output_t id)
+{
+    int i;
+
+    for (i = 0; i < montab.num; i ++)
+    {
+        if (id == montab.rects[i].id)
+        {
+            PDEBUG("findmonitor: Found it. Output ID: %d\n", id);
+            return montab.rects[i].mon;
+        }
+    }
+
+    return NULL;
+}
+
+/* Check if x,y is on rect, borders included. */
+static bool onmonrect(const struct monrect *rect, int16_t x, int16_t y)
+{
+    return x >= rect->x && x <= rect->x + rect->width
+        && y >= rect->y && y <= rect->y + rect->height;
+}
+
+/*
+ * Find the monitor x,y is on. If it's outside all monitors, find the
+ * closest one.
+ *
+ * Returns NULL only if there are no monitors.
+ */
+struct monitor *findmonbycoord(int16_t x, int16_t y)
+{
+    struct monrect *rect;
+    int32_t dx;
+    int32_t dy;
+    uint64_t dist;
+    uint64_t best = UINT64_MAX;
+    int closest = 0;
+    int i;
+
+    if (0 == montab.num)
+    {
+        return NULL;
+    }
+
+    /* Most of the time it's the same monitor as last time. */
+    if (onmonrect(&montab.rects[montab.last], x, y))
+    {
+        return montab.rects[montab.last].mon;
+    }
+
+    for (i = 0; i < montab.num; i ++)
+    {
+        rect = &montab.rects[i];
+
+        if (onmonrect(rect, x, y))
+        {
+            PDEBUG("findmonbycoord: Found it. Output ID: %d, name %s\n",
+                   rect->id, rect->mon->name);
+            montab.last = i;
+            return rect->mon;
+        }
+
+        /* Distance to the closest point on the monitor. */
+        dx = 0;
+        if (x < rect->x)
+        {
+            dx = rect->x - x;
+        }
+        else if (x > rect->x + rect->width)
+        {
+            dx = x - (rect->x + rect->width);
+        }
+
+        dy = 0;
+        if (y < rect->y)
+        {
+            dy = rect->y - y;
+        }
+        else if (y > rect->y + rect->height)
+        {
+            dy = y - (rect->y + rect->height);
+        }
+
+        dist = (uint64_t) dx * dx + (uint64_t) dy * dy;
+        if (dist < best)
+        {
+            best = dist;
+            closest = i;
+        }
+    }
+
+    PDEBUG("findmonbycoord: %d,%d is outside all monitors. Closest is %s.\n",
+           x, y, montab.rects[closest].mon->name);
+
+    return montab.rects[closest].mon;
+}
+
+void delmonitor(struct monitor *mon)
+{
+    PDEBUG("Deleting output %s.\n", mon->name);
+    freewsset(&mon->wsset);
+    free(mon->name);
+    freeitem(&monlist, NULL, mon->item);
+}
+
+struct monitor *addmonitor(xcb_randr_output_t id, char *name,
+                           uint32_t x, uint32_t y, uint16_t width,
+                           uint16_t height)
+{
+    struct item *item;
+    struct monitor *mon;
+
+    if (NULL == (item = additem(&monlist)))
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return NULL;
+    }
+
+    mon = malloc(sizeof (struct monitor));
+    if (NULL == mon)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        delitem(&monlist, item);
+        return NULL;
+    }
+
+    item->data = mon;
+
+    mon->id = id;
+    mon->name = name;
+    mon->x = x;
+    mon->y = y;
+    mon->width = width;
+    mon->height = height;
+    mon->item = item;
+
+    if (0 != initwsset(&mon->wsset))
+    {
+        fprintf(stderr, "Out of memory.\n");
+        freeitem(&monlist, NULL, item);
+        return NULL;
+    }
+
+    return mon;
+}
+
+/*
+ * Find out the stacking order of all windows on the root. Call after
+ * we asked for SubstructureNotify on the root so we don't miss any
+ * changes.
+ */
+void initstack(void)
+{
+    xcb_query_tree_reply_t *reply;
+    xcb_window_t *children;
+    int len;
+    int i;
+
+    reply = waitreply(xcb_query_tree(conn, screen->root).sequence, NULL);
+    if (NULL == reply)
+    {
+        return;
+    }
+
+    len = xcb_query_tree_children_length(reply);
+    children = xcb_query_tree_children(reply);
+
+    /* Children are listed bottom first. */
+    for (i = 0; i < len; i ++)
+    {
+        stackadd(children[i]);
+    }
+
+    free(reply);
+}
+
+/* Window win was created or reparented to the root. It's on top. */
+void stackadd(xcb_window_t win)
+{
+    struct item *item;
+
+    item = hashfind(&stacktab, win);
+    if (NULL != item)
+    {
+        movetohead(&stacklist, item);
+        return;
+    }
+
+    item = additem(&stacklist);
+    if (NULL == item)
+    {
+        PDEBUG("stackadd: Out of memory.\n");
+        return;
+    }
+
+    item->data = NULL;
+    if (0 != hashadd(&stacktab, win, item))
+    {
+        PDEBUG("stackadd: Out of memory.\n");
+        delitem(&stacklist, item);
+    }
+}
+
+/* Window win is gone from the root. */
+void stackdel(xcb_window_t win)
+{
+    struct item *item;
+
+    item = hashfind(&stacktab, win);
+    if (NULL != item)
+    {
+        hashdel(&stacktab, win);
+        delitem(&stacklist, item);
+    }
+}
+
+/*
+ * Window win is now right above sibling, or at the bottom if sibling
+ * is XCB_NONE.
+ */
+void stackabove(xcb_window_t win, xcb_window_t sibling)
+{
+    struct item *item;
+    struct item *below;
+
+    item = hashfind(&stacktab, win);
+    if (NULL == item)
+    {
+        /* We missed it somehow. Better late than never. */
+        stackadd(win);
+        item = hashfind(&stacktab, win);
+        if (NULL == item)
+        {
+            return;
+        }
+    }
+
+    if (XCB_NONE == sibling)
+    {
+        for (below = stacklist; NULL != below->next; below = below->next)
+            ;
+        movetonext(&stacklist, below, item);
+        return;
+    }
+
+    below = hashfind(&stacktab, sibling);
+    if (NULL == below || below->prev == item)
+    {
+        return;
+    }
+
+    if (NULL == below->prev)
+    {
+        movetohead(&stacklist, item);
+    }
+    else
+    {
+        movetonext(&stacklist, below->prev, item);
+    }
+}
+
+/* Check if win is the topmost window on the root. */
+bool ontop(xcb_window_t win)
+{
+    return NULL != stacklist && hashfind(&stacktab, win) == stacklist;
+}
+
+/* Raise window win to top of stack. */
+void raisewindow(xcb_drawable_t win)
+{
+    uint32_t values[] = { XCB_STACK_MODE_ABOVE };
+
+    if (screen->root == win || 0 == win)
+    {
+        return;
+    }
+
+    if (ontop(win))
+    {
+        norestacks ++;
+        return;
+    }
+
+    xcb_configure_window(conn, win,
+                         XCB_CONFIG_WINDOW_STACK_MODE,
+                         values);
+    restacks ++;
+
+    /*
+     * It will be on top, so don't raise it again before we see the
+     * ConfigureNotify.
+     */
+    stackadd(win);
+}
+
+/*
+ * Set window client to either top or bottom of stack depending on
+ * where it is now.
+ */
+void raiseorlower(struct client *client)
+{
+    uint32_t values[] = { XCB_STACK_MODE_OPPOSITE };
+    xcb_drawable_t win;
+
+    if (NULL == client)
     {
         return;
     }
 
-    focuswin->x = mon_x + mon_width - (focuswin->width + conf.borderwidth * 2);
-    focuswin->y =  mon_y + mon_height - (focuswin->height + conf.borderwidth
-                                         * 2);
-    movewindow(focuswin->id, focuswin->x, focuswin->y);
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     pointx, pointy);
-    xcb_flush(conn);
+    win = client->id;
+
+    /*
+     * We don't know if it's occluded or not, so let the server
+     * decide. The ConfigureNotify tells us what happened.
+     */
+    xcb_configure_window(conn, win,
+                         XCB_CONFIG_WINDOW_STACK_MODE,
+                         values);
+    restacks ++;
+}
+
+void movelim(struct client *client)
+{
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+
+    if (NULL == client->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_width = screen->width_in_pixels;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = client->monitor->x;
+        mon_y = client->monitor->y;
+        mon_width = client->monitor->width;
+        mon_height = client->monitor->height;
+    }
+
+    /* Is it outside the physical monitor? */
+    if (client->x < mon_x)
+    {
+        client->x = mon_x;
+    }
+    if (client->y < mon_y)
+    {
+        client->y = mon_y;
+    }
+
+    if (client->x + client->width > mon_x + mon_width - conf.borderwidth * 2)
+    {
+        client->x = (mon_x + mon_width - conf.borderwidth * 2) - client->width;
+    }
+
+    if (client->y + client->height > mon_y + mon_height - conf.borderwidth * 2)
+    {
+        client->y = (mon_y + mon_height - conf.borderwidth * 2)
+            - client->height;
+    }
+
+    movewindow(client->id, client->x, client->y);
+}
+
+/* Move window win to root coordinates x,y. */
+void movewindow(xcb_drawable_t win, uint16_t x, uint16_t y)
+{
+    uint32_t values[2];
+
+    if (screen->root == win || 0 == win)
+    {
+        /* Can't move root. */
+        return;
+    }
+
+    values[0] = x;
+    values[1] = y;
+
+    xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_X
+                         | XCB_CONFIG_WINDOW_Y, values);
+}
+
+/* Change focus to next in window ring. */
+void focusnext(bool reverse)
+{
+    struct client *client = NULL;
+    struct item *first;
+    struct item *item;
+
+#if DEBUG
+    if (NULL != focuswin)
+    {
+        PDEBUG("Focus now in win %d\n", focuswin->id);
+    }
+#endif
+
+    first = ringfirst();
+    if (NULL == first)
+    {
+        PDEBUG("No windows to focus on in this workspace.\n");
+        return;
+    }
+
+    if (MCWM_TABBING != mode)
+    {
+        /*
+         * Remember what we last focused on. We need this when the
+         * MODKEY is released and we move the last focused window in
+         * the tabbing order list.
+         */
+        lastfocuswin = focuswin;
+        mode = MCWM_TABBING;
+
+        PDEBUG("Began tabbing.\n");
+    }
+
+    /* If we currently have no focus focus first in list. */
+    if (NULL == focuswin || !onworkspace(focuswin)
+        || focuswin->monitor != curmon)
+    {
+        PDEBUG("Focusing first in list: %p\n", (void *) first);
+        client = first->data;
+
+        if (NULL != focuswin)
+        {
+            PDEBUG("XXX Our focused window %d isn't on this workspace!\n",
+                   focuswin->id);
+        }
+    }
+    else
+    {
+        if (reverse)
+        {
+            item = ringprev(focuswin->wsitem);
+            if (NULL == item)
+            {
+                /*
+                 * We were at the head of the ring. Focusing on last
+                 * window unless we were already there.
+                 */
+                item = ringlast();
+                PDEBUG("Beginning of ring. Focusing last: %p\n",
+                       (void *) item);
+            }
+        }
+        else
+        {
+            item = ringnext(focuswin->wsitem);
+            if (NULL == item)
+            {
+                /*
+                 * We were at the end of the ring. Focusing on first
+                 * window unless we were already there.
+                 */
+                item = first;
+                PDEBUG("End of ring. Focusing first: %p\n", (void *) item);
+            }
+        }
+
+        if (item != focuswin->wsitem)
+        {
+            client = item->data;
+        }
+    }
+
+    if (NULL != client)
+    {
+        /*
+         * Raise window if it's occluded, then warp pointer into it and
+         * set keyboard focus to it. Nothing can occlude the window on
+         * top.
+         */
+        uint32_t values[] = { XCB_STACK_MODE_TOP_IF };
+
+        if (ontop(client->id))
+        {
+            norestacks ++;
+        }
+        else
+        {
+            xcb_configure_window(conn, client->id,
+                                 XCB_CONFIG_WINDOW_STACK_MODE, values);
+            restacks ++;
+        }
+
+        xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
+                         client->width / 2, client->height / 2);
+        setfocus(client);
+    }
+}
+
+/* Mark window win as unfocused. */
+void setunfocus(xcb_drawable_t win)
+{
+    uint32_t values[1];
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    if (focuswin->id == screen->root)
+    {
+        return;
+    }
+
+    /* Set new border colour. */
+    values[0] = conf.unfocuscol;
+    xcb_change_window_attributes(conn, win, XCB_CW_BORDER_PIXEL, values);
+}
+
+/*
+ * Find client with client->id win.
+ *
+ * Returns client pointer or NULL if not found.
+ */
+struct client *findclient(xcb_drawable_t win)
+{
+    return hashfind(&clienttab, win);
+}
+
+/* Set focus on window client. */
+void setfocus(struct client *client)
+{
+    uint32_t values[1];
+
+    /*
+     * If client is NULL, we focus on whatever the pointer is on.
+     *
+     * This is a pathological case, but it will make the poor user
+     * able to focus on windows anyway, even though this window
+     * manager might be buggy.
+     */
+    if (NULL == client)
+    {
+        PDEBUG("setfocus: client was NULL!\n");
+
+        focuswin = NULL;
+
+        xcb_set_input_focus(conn, XCB_NONE, XCB_INPUT_FOCUS_POINTER_ROOT,
+                            XCB_CURRENT_TIME);
+
+        return;
+    }
+
+    /*
+     * Don't bother focusing on the root window or on the same window
+     * that already has focus.
+     */
+    if (client->id == screen->root || client == focuswin)
+    {
+        return;
+    }
+
+    /* Set new border colour. */
+    if (client->fixed)
+    {
+        values[0] = conf.fixedcol;
+    }
+    else
+    {
+        values[0] = conf.focuscol;
+    }
+
+    xcb_change_window_attributes(conn, client->id, XCB_CW_BORDER_PIXEL,
+                                 values);
+
+    /* Unset last focus. */
+    if (NULL != focuswin)
+    {
+        setunfocus(focuswin->id);
+    }
+
+    /* Set new input focus. */
+
+    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, client->id,
+                        XCB_CURRENT_TIME);
+
+    /* Remember the new window as the current focused window. */
+    focuswin = client;
+
+    /* Workspace keys now act on the monitor of this window. */
+    curmon = client->monitor;
+}
+
+int start(char *program)
+{
+    pid_t pid;
+
+    pid = fork();
+    if (-1 == pid)
+    {
+        perror("fork");
+        return -1;
+    }
+    else if (0 == pid)
+    {
+        char *argv[2];
+
+        /* In the child. */
+
+        /*
+         * Make this process a new process leader, otherwise the
+         * terminal will die when the wm dies. Also, this makes any
+         * SIGCHLD go to this process when we fork again.
+         */
+        if (-1 == setsid())
+        {
+            perror("setsid");
+            exit(1);
+        }
+
+#ifdef __linux__
+        {
+            sigset_t mask;
+
+            /* Don't let the program inherit the signals we block. */
+            sigemptyset(&mask);
+            sigprocmask(SIG_SETMASK, &mask, NULL);
+        }
+#endif
+
+        argv[0] = program;
+        argv[1] = NULL;
+
+        if (-1 == execvp(program, argv))
+        {
+            perror("execve");
+            exit(1);
+        }
+        exit(0);
+    }
+
+    return 0;
+}
+
+/* Resize with limit. */
+void resizelim(struct client *client)
+{
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+
+    if (NULL == client->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_width = screen->width_in_pixels;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = client->monitor->x;
+        mon_y = client->monitor->y;
+        mon_width = client->monitor->width;
+        mon_height = client->monitor->height;
+    }
+
+    /* Is it smaller than it wants to  be? */
+    if (0 != client->min_height && client->height < client->min_height)
+    {
+        client->height = client->min_height;
+    }
+
+    if (0 != client->min_width && client->width < client->min_width)
+    {
+        client->width = client->min_width;
+    }
+
+    if (client->x + client->width + conf.borderwidth * 2 > mon_x + mon_width)
+    {
+        client->width = mon_width - ((client->x - mon_x) + conf.borderwidth
+                                     * 2);
+    }
+
+    if (client->y + client->height + conf.borderwidth * 2 > mon_y + mon_height)
+    {
+        client->height = mon_height - ((client->y - mon_y) + conf.borderwidth
+                                       * 2);
+    }
+
+    resize(client->id, client->width, client->height);
+}
+
+void moveresize(xcb_drawable_t win, uint16_t x, uint16_t y,
+                uint16_t width, uint16_t height)
+{
+    uint32_t values[4];
+
+    if (screen->root == win || 0 == win)
+    {
+        /* Can't move or resize root. */
+        return;
+    }
+
+    PDEBUG("Moving to %d, %d, resizing to %d x %d.\n", x, y, width, height);
+
+    values[0] = x;
+    values[1] = y;
+    values[2] = width;
+    values[3] = height;
+
+    xcb_configure_window(conn, win,
+                         XCB_CONFIG_WINDOW_X
+                         | XCB_CONFIG_WINDOW_Y
+                         | XCB_CONFIG_WINDOW_WIDTH
+                         | XCB_CONFIG_WINDOW_HEIGHT, values);
+}
+
+/* Resize window win to width,height. */
+void resize(xcb_drawable_t win, uint16_t width, uint16_t height)
+{
+    uint32_t values[2];
+
+    if (screen->root == win || 0 == win)
+    {
+        /* Can't resize root. */
+        return;
+    }
+
+    PDEBUG("Resizing to %d x %d.\n", width, height);
+
+    values[0] = width;
+    values[1] = height;
+
+    xcb_configure_window(conn, win,
+                         XCB_CONFIG_WINDOW_WIDTH
+                         | XCB_CONFIG_WINDOW_HEIGHT, values);
+}
+
+/*
+ * Resize window client in direction direction. Direction is:
+ *
+ * h = left, that is decrease width.
+ *
+ * j = down, that is, increase height.
+ *
+ * k = up, that is, decrease height.
+ *
+ * l = right, that is, increase width.
+ */
+void resizestep(struct client *client, char direction)
+{
+    int step_x = MOVE_STEP;
+    int step_y = MOVE_STEP;
+
+    if (NULL == client)
+    {
+        return;
+    }
+
+    if (client->maxed)
+    {
+        /* Can't resize a fully maximized window. */
+        return;
+    }
+
+    raisewindow(client->id);
+
+    if (client->width_inc > 1)
+    {
+        step_x = client->width_inc;
+    }
+    else
+    {
+        step_x = MOVE_STEP;
+    }
+
+    if (client->height_inc > 1)
+    {
+        step_y = client->height_inc;
+    }
+    else
+    {
+        step_y = MOVE_STEP;
+    }
+
+    switch (direction)
+    {
+    case 'h':
+        client->width = client->width - step_x;
+        break;
+
+    case 'j':
+        client->height = client->height + step_y;
+        break;
+
+    case 'k':
+        client->height = client->height - step_y;
+        break;
+
+    case 'l':
+        client->width = client->width + step_x;
+        break;
+
+    default:
+        PDEBUG("resizestep in unknown direction.\n");
+        break;
+    } /* switch direction */
+
+    resizelim(client);
+
+    /* If this window was vertically maximized, remember that it isn't now. */
+    if (client->vertmaxed)
+    {
+        client->vertmaxed = false;
+        statedirty = true;
+    }
+
+    xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
+                     client->width / 2, client->height / 2);
+}
+
+/*
+ * Collect the edges of all windows client might snap to while we drag
+ * it.
+ */
+static void buildsnap(struct client *client)
+{
+    struct item *item;
+    struct client *win;
+    int err = 0;
+
+    edgeclear(&snap.right);
+    edgeclear(&snap.bottom);
+    edgeclear(&snap.left);
+    edgeclear(&snap.top);
+
+    /*
+     * Go through all windows on current workspace, fixed windows
+     * included.
+     */
+    for (item = ringfirst(); item != NULL; item = ringnext(item))
+    {
+        win = item->data;
+
+        if (client == win)
+        {
+            continue;
+        }
+
+        err |= edgeadd(&snap.right, win->x + win->width,
+                       win->y, win->y + win->height);
+        err |= edgeadd(&snap.bottom, win->y + win->height,
+                       win->x, win->x + win->width);
+        err |= edgeadd(&snap.left, win->x, win->y, win->y + win->height);
+        err |= edgeadd(&snap.top, win->y, win->x, win->x + win->width);
+    }
+
+    if (0 != err)
+    {
+        PDEBUG("buildsnap: Out of memory. Won't snap to all windows.\n");
+    }
+
+    edgesort(&snap.right);
+    edgesort(&snap.bottom);
+    edgesort(&snap.left);
+    edgesort(&snap.top);
+}
+
+/*
+ * Try to snap to other windows and monitor border. The other windows
+ * are the ones buildsnap() found. If more than one window is close
+ * enough, snap to the closest.
+ */
+static void snapwindow(struct client *client, int snap_mode)
+{
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+    int32_t pos;
+
+    if (NULL == client->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_width = screen->width_in_pixels;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = client->monitor->x;
+        mon_y = client->monitor->y;
+        mon_width = client->monitor->width;
+        mon_height = client->monitor->height;
+    }
+
+    if (snap_mode == MCWM_MOVE)
+    {
+        if (edgefind(&snap.right, client->x, conf.snapmargin,
+                     client->y, client->y + client->height, &pos))
+        {
+            client->x = pos + (2 * conf.borderwidth);
+        }
+
+        if (edgefind(&snap.bottom, client->y, conf.snapmargin,
+                     client->x, client->x + client->width, &pos))
+        {
+            client->y = pos + (2 * conf.borderwidth);
+        }
+
+        if (edgefind(&snap.left, client->x + client->width, conf.snapmargin,
+                     client->y, client->y + client->height, &pos))
+        {
+            client->x = (pos - client->width) - (2 * conf.borderwidth);
+        }
+
+        if (edgefind(&snap.top, client->y + client->height, conf.snapmargin,
+                     client->x, client->x + client->width, &pos))
+        {
+            client->y = (pos - client->height) - (2 * conf.borderwidth);
+        }
+    } /* mcwm_move */
+    else if (snap_mode == MCWM_RESIZE)
+    {
+        if (edgefind(&snap.left, client->x + client->width, conf.snapmargin,
+                     client->y, client->y + client->height, &pos))
+        {
+            client->width = (pos - client->x) - (2 * conf.borderwidth);
+        }
+
+        if (edgefind(&snap.top, client->y + client->height, conf.snapmargin,
+                     client->x, client->x + client->width, &pos))
+        {
+            client->height = (pos - client->y) - (2 * conf.borderwidth);
+        }
+    } /* mcwm_resize */
+
+    /* monitor border */
+    if (snap_mode == MCWM_MOVE) {
+
+        if (abs(client->x - mon_x) < conf.snapmargin)
+        {
+            client->x = mon_x;
+        }
+
+        if (abs(client->y - mon_y) < conf.snapmargin)
+        {
+            client->y = mon_y;
+        }
+
+        if (abs((client->x + client->width) - mon_width) < conf.snapmargin)
+        {
+            client->x = (mon_width - client->width);
+        }
+
+        if (abs((client->y + client->height) - mon_height) < conf.snapmargin)
+        {
+            client->y = (mon_height - client->height);
+        }
+    }
+    else if (snap_mode == MCWM_RESIZE)
+    {
+        if (abs((client->width + client->x) - mon_width) < conf.snapmargin)
+        {
+            client->width = mon_width;
+        }
+        if (abs((client->height + client->y) - mon_height) < conf.snapmargin)
+        {
+            client->height = mon_height;
+        }
+    }
+}
+
+/*
+ * Move window win as a result of pointer motion to coordinates
+ * rel_x,rel_y.
+ */
+void mousemove(struct client *client, int rel_x, int rel_y)
+{
+    client->x = rel_x;
+    client->y = rel_y;
+
+    if (conf.snapmargin > 0)
+    {
+        snapwindow(client, MCWM_MOVE);
+    }
+
+    movelim(client);
+}
+
+void mouseresize(struct client *client, int rel_x, int rel_y)
+{
+
+    client->width = abs(rel_x - client->x);
+    client->height = abs(rel_y - client->y);
+
+    client->width -= (client->width - client->base_width) % client->width_inc;
+    client->height -= (client->height - client->base_height)
+        % client->height_inc;
+
+    PDEBUG("Trying to resize to %dx%d (%dx%d)\n", client->width, client->height,
+           (client->width - client->base_width) / client->width_inc,
+           (client->height - client->base_height) / client->height_inc);
+
+    if (conf.snapmargin > 0)
+    {
+        snapwindow(client, MCWM_RESIZE);
+    }
+
+    resizelim(client);
+
+    /* If this window was vertically maximized, remember that it isn't now. */
+    if (client->vertmaxed)
+    {
+        client->vertmaxed = false;
+        statedirty = true;
+    }
+}
+
+/*
+ * Move or resize client to follow the pointer position saved in drag.
+ *
+ * Unless force is set, don't update the window more than
+ * conf.dragrate times per second. If we skip an update it's still
+ * pending and will be done on the next call, or by dragflush() when
+ * it's time if the pointer stops moving.
+ */
+void dragupdate(struct client *client, bool force)
+{
+    uint64_t now;
+    uint64_t wait;
+
+    if (!drag.pending)
+    {
+        return;
+    }
+
+    if (0 != conf.dragrate && !force)
+    {
+        now = getmsec();
+        wait = 1000 / (uint64_t) conf.dragrate;
+        if (now - drag.last < wait)
+        {
+            drag.timer.func = dragflush;
+            settimer(&drag.timer, drag.last + wait - now);
+            return;
+        }
+        drag.last = now;
+    }
+
+    deltimer(&drag.timer);
+    drag.pending = false;
+
+    if (mode == MCWM_MOVE)
+    {
+        mousemove(client, drag.x, drag.y);
+    }
+    else if (mode == MCWM_RESIZE)
+    {
+        mouseresize(client, drag.x, drag.y);
+    }
+    else
+    {
+        PDEBUG("Motion event when we're not moving our resizing!\n");
+    }
+}
+
+/*
+ * Do the window update dragupdate() skipped, now that it's time.
+ */
+void dragflush(void)
+{
+    if ((mode != MCWM_MOVE && mode != MCWM_RESIZE) || NULL == focuswin
+        || focuswin->maxed)
+    {
+        drag.pending = false;
+        return;
+    }
+
+    dragupdate(focuswin, true);
+}
+
+void movestep(struct client *client, char direction)
+{
+    int16_t start_x;
+    int16_t start_y;
+
+    if (NULL == client)
+    {
+        return;
+    }
+
+    if (client->maxed)
+    {
+        /* We can't move a fully maximized window. */
+        return;
+    }
+
+    /* Save pointer position so we can warp pointer here later. */
+    if (!getpointer(client->id, &start_x, &start_y))
+    {
+        return;
+    }
+
+    raisewindow(client->id);
+    switch (direction)
+    {
+    case 'h':
+        client->x = client->x - MOVE_STEP;
+        break;
+
+    case 'j':
+        client->y = client->y + MOVE_STEP;
+        break;
+
+    case 'k':
+        client->y = client->y - MOVE_STEP;
+        break;
+
+    case 'l':
+        client->x = client->x + MOVE_STEP;
+        break;
+
+    default:
+        PDEBUG("movestep: Moving in unknown direction.\n");
+        break;
+    } /* switch direction */
+
+    movelim(client);
+
+    /*
+     * If the pointer was inside the window to begin with, move
+     * pointer back to where it was, relative to the window.
+     */
+    if (start_x > 0 - conf.borderwidth && start_x < client->width
+        + conf.borderwidth && start_y > 0 - conf.borderwidth && start_y
+        < client->height + conf.borderwidth)
+    {
+        xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
+                         start_x, start_y);
+    }
+}
+
+void setborders(struct client *client, int width)
+{
+    uint32_t values[1];
+    uint32_t mask = 0;
+
+    values[0] = width;
+
+    mask |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
+    xcb_configure_window(conn, client->id, mask, &values[0]);
+}
+
+void unmax(struct client *client)
+{
+    uint32_t values[5];
+    uint32_t mask = 0;
+
+    if (NULL == client)
+    {
+        PDEBUG("unmax: client was NULL!\n");
+        return;
+    }
+
+    client->x = client->origsize.x;
+    client->y = client->origsize.y;
+    client->width = client->origsize.width;
+    client->height = client->origsize.height;
+
+    /* Restore geometry. */
+    if (client->maxed)
+    {
+        values[0] = client->x;
+        values[1] = client->y;
+        values[2] = client->width;
+        values[3] = client->height;
+
+        /* Set borders again. */
+        values[4] = conf.borderwidth;
+
+        mask =
+            XCB_CONFIG_WINDOW_X
+            | XCB_CONFIG_WINDOW_Y
+            | XCB_CONFIG_WINDOW_WIDTH
+            | XCB_CONFIG_WINDOW_HEIGHT
+            | XCB_CONFIG_WINDOW_BORDER_WIDTH;
+    }
+    else
+    {
+        values[0] = client->y;
+        values[1] = client->width;
+        values[2] = client->height;
+
+        mask = XCB_CONFIG_WINDOW_Y
+            | XCB_CONFIG_WINDOW_WIDTH
+            | XCB_CONFIG_WINDOW_HEIGHT;
+    }
+
+    xcb_configure_window(conn, client->id, mask, values);
+
+    /* Warp pointer to window or we might lose it. */
+    xcb_warp_pointer(conn, XCB_NONE, client->id, 0, 0, 0, 0,
+                     client->width / 2, client->height / 2);
+}
+
+void maximize(struct client *client)
+{
+    uint32_t values[4];
+    uint32_t mask = 0;
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+
+    if (NULL == client)
+    {
+        PDEBUG("maximize: client was NULL!\n");
+        return;
+    }
+
+    if (NULL == client->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_width = screen->width_in_pixels;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = client->monitor->x;
+        mon_y = client->monitor->y;
+        mon_width = client->monitor->width;
+        mon_height = client->monitor->height;
+    }
+
+    /*
+     * Check if maximized already. If so, revert to stored
+     * geometry.
+     */
+    if (client->maxed)
+    {
+        unmax(client);
+        client->maxed = false;
+        statedirty = true;
+        return;
+    }
+
+    /* Raise first. Pretty silly to maximize below something else. */
+    raisewindow(client->id);
+
+    /* Remember original geometry. It's saved in _MCWM_STATE as well. */
+    client->origsize.x = client->x;
+    client->origsize.y = client->y;
+    client->origsize.width = client->width;
+    client->origsize.height = client->height;
+
+    /* Remove borders. */
+    values[0] = 0;
+    mask = XCB_CONFIG_WINDOW_BORDER_WIDTH;
+    xcb_configure_window(conn, client->id, mask, values);
+
+    /* Move to top left and resize. */
+    client->x = mon_x;
+    client->y = mon_y;
+    client->width = mon_width;
+    client->height = mon_height;
+
+    values[0] = client->x;
+    values[1] = client->y;
+    values[2] = client->width;
+    values[3] = client->height;
+    xcb_configure_window(conn, client->id, XCB_CONFIG_WINDOW_X
+                         | XCB_CONFIG_WINDOW_Y
+                         | XCB_CONFIG_WINDOW_WIDTH
+                         | XCB_CONFIG_WINDOW_HEIGHT, values);
+
+    client->maxed = true;
+    statedirty = true;
+}
+
+void maxvert(struct client *client)
+{
+    uint32_t values[2];
+    int16_t mon_y;
+    uint16_t mon_height;
+
+    if (NULL == client)
+    {
+        PDEBUG("maxvert: client was NULL\n");
+        return;
+    }
+
+    if (NULL == client->monitor)
+    {
+        mon_y = 0;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_y = client->monitor->y;
+        mon_height = client->monitor->height;
+    }
+
+    /*
+     * Check if maximized already. If so, revert to stored geometry.
+     */
+    if (client->vertmaxed)
+    {
+        unmax(client);
+        client->vertmaxed = false;
+        statedirty = true;
+        return;
+    }
+
+    /* Raise first. Pretty silly to maximize below something else. */
+    raisewindow(client->id);
+
+    /*
+     * Store original coordinates and geometry. It's saved in
+     * _MCWM_STATE as well.
+     */
+    client->origsize.x = client->x;
+    client->origsize.y = client->y;
+    client->origsize.width = client->width;
+    client->origsize.height = client->height;
+
+    client->y = mon_y;
+    /* Compute new height considering height increments and screen height. */
+    client->height = mon_height - conf.borderwidth * 2;
+    client->height -= (client->height - client->base_height)
+        % client->height_inc;
+
+    /* Move to top of screen and resize. */
+    values[0] = client->y;
+    values[1] = client->height;
+
+    xcb_configure_window(conn, client->id, XCB_CONFIG_WINDOW_Y
+                         | XCB_CONFIG_WINDOW_HEIGHT, values);
+
+    /* Remember that this client is vertically maximized. */
+    client->vertmaxed = true;
+    statedirty = true;
+}
+
+void hide(struct client *client)
+{
+    long data[] = { XCB_ICCCM_WM_STATE_ICONIC, XCB_NONE };
+
+    /*
+     * Unmap window and declare iconic.
+     *
+     * Unmapping will generate an UnmapNotify event so we can forget
+     * about the window later.
+     */
+    xcb_unmap_window(conn, client->id);
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
+                        wm_state, wm_state, 32, 2, data);
+}
+
+bool getpointer(xcb_drawable_t win, int16_t *x, int16_t *y)
+{
+    xcb_query_pointer_reply_t *pointer;
+
+    pointer = waitreply(xcb_query_pointer(conn, win).sequence, NULL);
+    if (NULL == pointer)
+    {
+        return false;
+    }
+
+    *x = pointer->win_x;
+    *y = pointer->win_y;
+
+    free(pointer);
+
+    return true;
+}
+
+/*
+ * Collect the geometry asked for with cookie.
+ *
+ * Returns true if we got it.
+ */
+bool getgeom(xcb_get_geometry_cookie_t cookie, int16_t *x, int16_t *y,
+             uint16_t *width, uint16_t *height)
+{
+    xcb_get_geometry_reply_t *geom;
+
+    geom = waitreply(cookie.sequence, NULL);
+    if (NULL == geom)
+    {
+        return false;
+    }
+
+    *x = geom->x;
+    *y = geom->y;
+    *width = geom->width;
+    *height = geom->height;
+
+    free(geom);
+
+    return true;
+}
+
+void topleft(void)
+{
+    int16_t pointx;
+    int16_t pointy;
+    int16_t mon_x;
+    int16_t mon_y;
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    if (NULL == focuswin->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+    }
+    else
+    {
+        mon_x = focuswin->monitor->x;
+        mon_y = focuswin->monitor->y;
+    }
+
+    raisewindow(focuswin->id);
+
+    if (!getpointer(focuswin->id, &pointx, &pointy))
+    {
+        return;
+    }
+
+    focuswin->x = mon_x;
+    focuswin->y = mon_y;
+    movewindow(focuswin->id, focuswin->x, focuswin->y);
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     pointx, pointy);
+}
+
+void topright(void)
+{
+    int16_t pointx;
+    int16_t pointy;
+    int16_t mon_x;
+    uint16_t mon_y;
+    uint16_t mon_width;
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    if (NULL == focuswin->monitor)
+    {
+        mon_width = screen->width_in_pixels;
+        mon_x = 0;
+        mon_y = 0;
+    }
+    else
+    {
+        mon_width = focuswin->monitor->width;
+        mon_x = focuswin->monitor->x;
+        mon_y = focuswin->monitor->y;
+    }
+
+    raisewindow(focuswin->id);
+
+    if (!getpointer(focuswin->id, &pointx, &pointy))
+    {
+        return;
+    }
+
+    focuswin->x = mon_x + mon_width -
+        (focuswin->width + conf.borderwidth * 2);
+
+    focuswin->y = mon_y;
+
+    movewindow(focuswin->id, focuswin->x, focuswin->y);
+
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     pointx, pointy);
+}
+
+void botleft(void)
+{
+    int16_t pointx;
+    int16_t pointy;
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_height;
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    if (NULL == focuswin->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = focuswin->monitor->x;
+        mon_y = focuswin->monitor->y;
+        mon_height = focuswin->monitor->height;
+    }
+
+    raisewindow(focuswin->id);
+
+    if (!getpointer(focuswin->id, &pointx, &pointy))
+    {
+        return;
+    }
+
+    focuswin->x = mon_x;
+    focuswin->y = mon_y + mon_height - (focuswin->height + conf.borderwidth
+                                        * 2);
+    movewindow(focuswin->id, focuswin->x, focuswin->y);
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     pointx, pointy);
+}
+
+void botright(void)
+{
+    int16_t pointx;
+    int16_t pointy;
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    if (NULL == focuswin->monitor)
+    {
+        mon_x = 0;
+        mon_y = 0;
+        mon_width = screen->width_in_pixels;;
+        mon_height = screen->height_in_pixels;
+    }
+    else
+    {
+        mon_x = focuswin->monitor->x;
+        mon_y = focuswin->monitor->y;
+        mon_width = focuswin->monitor->width;
+        mon_height = focuswin->monitor->height;
+    }
+
+    raisewindow(focuswin->id);
+
+    if (!getpointer(focuswin->id, &pointx, &pointy))
+    {
+        return;
+    }
+
+    focuswin->x = mon_x + mon_width - (focuswin->width + conf.borderwidth * 2);
+    focuswin->y =  mon_y + mon_height - (focuswin->height + conf.borderwidth
+                                         * 2);
+    movewindow(focuswin->id, focuswin->x, focuswin->y);
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     pointx, pointy);
+}
+
+void deletewin(void)
+{
+    xcb_get_property_cookie_t cookie;
+    xcb_get_property_reply_t *reply;
+    xcb_icccm_get_wm_protocols_reply_t protocols;
+    bool use_delete = false;
+    uint32_t i;
+
+    if (NULL == focuswin)
+    {
+        return;
+    }
+
+    /* Check if WM_DELETE is supported.  */
+    cookie = xcb_icccm_get_wm_protocols_unchecked(conn, focuswin->id,
+                                                  wm_protocols);
+    reply = waitreply(cookie.sequence, NULL);
+    if (NULL != reply
+        && xcb_icccm_get_wm_protocols_from_reply(reply, &protocols) == 1)
+    {
+        for (i = 0; i < protocols.atoms_len; i++)
+        {
+            if (protocols.atoms[i] == wm_delete_window)
+            {
+                 use_delete = true;
+            }
+        }
+
+        /* Frees reply too. */
+        xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+    }
+    else
+    {
+        free(reply);
+    }
+
+    if (use_delete)
+    {
+        xcb_client_message_event_t ev = {
+          .response_type = XCB_CLIENT_MESSAGE,
+          .format = 32,
+          .sequence = 0,
+          .window = focuswin->id,
+          .type = wm_protocols,
+          .data.data32 = { wm_delete_window, XCB_CURRENT_TIME }
+        };
+
+        xcb_send_event(conn, false, focuswin->id,
+                       XCB_EVENT_MASK_NO_EVENT, (char *) &ev);
+    }
+    else
+    {
+        xcb_kill_client(conn, focuswin->id);
+    }
+}
+
+void prevscreen(void)
+{
+    struct item *item;
+
+    if (NULL == focuswin || NULL == focuswin->monitor)
+    {
+        return;
+    }
+
+    item = focuswin->monitor->item->prev;
+
+    if (NULL == item)
+    {
+        return;
+    }
+
+    setmonitor(focuswin, item->data);
+    curmon = focuswin->monitor;
+
+    raisewindow(focuswin->id);
+    fitonscreen(focuswin);
+    movelim(focuswin);
+
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     0, 0);
+}
+
+void nextscreen(void)
+{
+    struct item *item;
+
+    if (NULL == focuswin || NULL == focuswin->monitor)
+    {
+        return;
+    }
+
+    item = focuswin->monitor->item->next;
+
+    if (NULL == item)
+    {
+        return;
+    }
+
+    setmonitor(focuswin, item->data);
+    curmon = focuswin->monitor;
+
+    raisewindow(focuswin->id);
+    fitonscreen(focuswin);
+    movelim(focuswin);
+
+    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
+                     0, 0);
+}
+
+void handle_keypress(xcb_key_press_event_t *ev)
+{
+    int i;
+    key_enum_t key;
+
+    for (key = KEY_MAX, i = KEY_F; i < KEY_MAX; i ++)
+    {
+        if (ev->detail == keys[i].keycode && 0 != keys[i].keycode)
+        {
+            key = i;
+            break;
+        }
+    }
+    if (key == KEY_MAX)
+    {
+        PDEBUG("Unknown key pressed.\n");
+
+        /*
+         * We don't know what to do with this key. Send this key press
+         * event to the focused window.
+         */
+        xcb_send_event(conn, false, XCB_SEND_EVENT_DEST_ITEM_FOCUS,
+                       XCB_EVENT_MASK_NO_EVENT, (char *) ev);
+        return;
+    }
+
+    if (MCWM_TABBING == mode && key != KEY_TAB && key != KEY_BACKTAB)
+    {
+        /* First finish tabbing around. Then deal with the next key. */
+        finishtabbing();
+    }
+
+    /* Is it shifted? */
+    if (ev->state & SHIFTMOD)
+    {
+        switch (key)
+        {
+        case KEY_H: /* h */
+            resizestep(focuswin, 'h');
+            break;
+
+        case KEY_J: /* j */
+            resizestep(focuswin, 'j');
+            break;
+
+        case KEY_K: /* k */
+            resizestep(focuswin, 'k');
+            break;
+
+        case KEY_L: /* l */
+            resizestep(focuswin, 'l');
+            break;
+
+        case KEY_TAB: /* shifted tab counts as backtab */
+            focusnext(true);
+            break;
+
+        default:
+            /* Ignore other shifted keys. */
+            break;
+        }
+    }
+    else
+    {
+        switch (key)
+        {
+        case KEY_RET: /* return */
+            start(conf.terminal);
+            break;
+
+        case KEY_F: /* f */
+            fixwindow(focuswin, true);
+            break;
+
+        case KEY_H: /* h */
+            movestep(focuswin, 'h');
+            break;
+
+        case KEY_J: /* j */
+            movestep(focuswin, 'j');
+            break;
+
+        case KEY_K: /* k */
+            movestep(focuswin, 'k');
+            break;
+
+        case KEY_L: /* l */
+            movestep(focuswin, 'l');
+            break;
+
+        case KEY_TAB: /* tab */
+            focusnext(false);
+            break;
+
+        case KEY_BACKTAB: /* backtab */
+            focusnext(true);
+            break;
+
+        case KEY_M: /* m */
+            maxvert(focuswin);
+            break;
+
+        case KEY_R: /* r*/
+            raiseorlower(focuswin);
+            break;
+
+        case KEY_X: /* x */
+            maximize(focuswin);
+            break;
+
+        case KEY_1:
+            changeworkspace(0);
+            break;
+
+        case KEY_2:
+            changeworkspace(1);
+            break;
+
+        case KEY_3:
+            changeworkspace(2);
+            break;
+
+        case KEY_4:
+            changeworkspace(3);
+            break;
+
+        case KEY_5:
+            changeworkspace(4);
+            break;
+
+        case KEY_6:
+            changeworkspace(5);
+            break;
+
+        case KEY_7:
+            changeworkspace(6);
+            break;
+
+        case KEY_8:
+            changeworkspace(7);
+            break;
+
+        case KEY_9:
+            changeworkspace(8);
+            break;
+
+        case KEY_0:
+            changeworkspace(9);
+            break;
+
+        case KEY_Y:
+            topleft();
+            break;
+
+        case KEY_U:
+            topright();
+            break;
+
+        case KEY_B:
+            botleft();
+            break;
+
+        case KEY_N:
+            botright();
+            break;
+
+        case KEY_END:
+            deletewin();
+            break;
+
+        case KEY_PREVSCR:
+            prevscreen();
+            break;
+
+        case KEY_NEXTSCR:
+            nextscreen();
+            break;
+
+        case KEY_ICONIFY:
+            if (conf.allowicons)
+            {
+                hide(focuswin);
+            }
+            break;
+
+        case KEY_PREVWS:
+            if (curset()->curws > 0)
+            {
+                changeworkspace(curset()->curws - 1);
+            }
+            else
+            {
+                changeworkspace(conf.workspaces - 1);
+            }
+            break;
+
+        case KEY_NEXTWS:
+            changeworkspace((curset()->curws + 1) % conf.workspaces);
+            break;
+
+        default:
+            /* Ignore other keys. */
+            break;
+        } /* switch unshifted */
+    }
+} /* handle_keypress() */
+
+/* Helper function to configure a window. */
+void configwin(xcb_window_t win, uint16_t mask, struct winconf wc)
+{
+    uint32_t values[7];
+    int i = -1;
+
+    if (mask & XCB_CONFIG_WINDOW_X)
+    {
+        mask |= XCB_CONFIG_WINDOW_X;
+        i ++;
+        values[i] = wc.x;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_Y)
+    {
+        mask |= XCB_CONFIG_WINDOW_Y;
+        i ++;
+        values[i] = wc.y;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_WIDTH)
+    {
+        mask |= XCB_CONFIG_WINDOW_WIDTH;
+        i ++;
+        values[i] = wc.width;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_HEIGHT)
+    {
+        mask |= XCB_CONFIG_WINDOW_HEIGHT;
+        i ++;
+        values[i] = wc.height;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_SIBLING)
+    {
+        mask |= XCB_CONFIG_WINDOW_SIBLING;
+        i ++;
+        values[i] = wc.sibling;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_STACK_MODE)
+    {
+        mask |= XCB_CONFIG_WINDOW_STACK_MODE;
+        i ++;
+        values[i] = wc.stackmode;
+    }
+
+    if (-1 != i)
+    {
+        xcb_configure_window(conn, win, mask, values);
+    }
+}
+
+void configurerequest(xcb_configure_request_event_t *e)
+{
+    struct client *client;
+    struct winconf wc;
+    int16_t mon_x;
+    int16_t mon_y;
+    uint16_t mon_width;
+    uint16_t mon_height;
+
+    PDEBUG("event: Configure request. mask = %d\n", e->value_mask);
+
+    /* Find the client. */
+    if ((client = findclient(e->window)))
+    {
+        /* Find monitor position and size. */
+        if (NULL == client || NULL == client->monitor)
+        {
+            mon_x = 0;
+            mon_y = 0;
+            mon_width = screen->width_in_pixels;
+            mon_height = screen->height_in_pixels;
+        }
+        else
+        {
+            mon_x = client->monitor->x;
+            mon_y = client->monitor->y;
+            mon_width = client->monitor->width;
+            mon_height = client->monitor->height;
+        }
+
+#if 0
+        /*
+         * We ignore moves the user haven't initiated, that is do
+         * nothing on XCB_CONFIG_WINDOW_X and XCB_CONFIG_WINDOW_Y
+         * ConfigureRequests.
+         *
+         * Code here if we ever change our minds or if you, dear user,
+         * wants this functionality.
+         */
+
+        if (e->value_mask & XCB_CONFIG_WINDOW_X)
+        {
+            /* Don't move window if maximized. Don't move off the screen. */
+            if (!client->maxed && e->x > 0)
+            {
+                client->x = e->x;
+            }
+        }
+
+        if (e->value_mask & XCB_CONFIG_WINDOW_Y)
+        {
+            /*
+             * Don't move window if maximized. Don't move off the
+             * screen.
+             */
+            if (!client->maxed && !client->vertmaxed && e->y > 0)
+            {
+                client->y = e->y;
+            }
+        }
+#endif
+
+        if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH)
+        {
+            /* Don't resize if maximized. */
+            if (!client->maxed)
+            {
+                client->width = e->width;
+            }
+        }
+
+        if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
+        {
+            /* Don't resize if maximized. */
+            if (!client->maxed && !client->vertmaxed)
+            {
+                client->height = e->height;
+            }
+        }
+
+        /*
+         * XXX Do we really need to pass on sibling and stack mode
+         * configuration? Do we want to?
+         *
+         * A sibling only means something together with a stack mode,
+         * so send them in the same request. Don't bother raising a
+         * window that is already on top.
+         */
+        if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+        {
+            uint32_t values[2];
+            uint16_t mask = XCB_CONFIG_WINDOW_STACK_MODE;
+            int i = 0;
+
+            if (e->value_mask & XCB_CONFIG_WINDOW_SIBLING)
+            {
+                values[i ++] = e->sibling;
+                mask |= XCB_CONFIG_WINDOW_SIBLING;
+            }
+            values[i] = e->stack_mode;
+
+            if (!(e->value_mask & XCB_CONFIG_WINDOW_SIBLING)
+                && (XCB_STACK_MODE_ABOVE == e->stack_mode
+                    || XCB_STACK_MODE_TOP_IF == e->stack_mode)
+                && ontop(e->window))
+            {
+                norestacks ++;
+            }
+            else
+            {
+                xcb_configure_window(conn, e->window, mask, values);
+                restacks ++;
+            }
+        }
+
+        /* Check if window fits on screen after resizing. */
+
+        if (client->x + client->width + 2 * conf.borderwidth
+            > mon_x + mon_width)
+        {
+            /*
+             * See if it fits if we move away the window from the
+             * right edge of the screen.
+             */
+            client->x = mon_x + mon_width
+                - (client->width + 2 * conf.borderwidth);
+
+            /*
+             * If we moved over the left screen edge, move back and
+             * fit exactly on screen.
+             */
+            if (client->x < mon_x)
+            {
+                client->x = mon_x;
+                client->width = mon_width - 2 * conf.borderwidth;
+            }
+        }
+
+        if (client->y + client->height + 2 * conf.borderwidth
+            > mon_y + mon_height)
+        {
+            /*
+             * See if it fits if we move away the window from the
+             * bottom edge.
+             */
+            client->y = mon_y + mon_height
+                - (client->height + 2 * conf.borderwidth);
+
+            /*
+             * If we moved over the top screen edge, move back and fit
+             * on screen.
+             */
+            if (client->y < mon_y)
+            {
+                PDEBUG("over the edge: y < %d\n", mon_y);
+                client->y = mon_y;
+                client->height = mon_height - 2 * conf.borderwidth;
+            }
+        }
+
+        moveresize(client->id, client->x, client->y, client->width,
+                   client->height);
+    }
+    else
+    {
+        PDEBUG("We don't know about this window yet.\n");
+
+        /*
+         * Unmapped window. Just pass all options except border
+         * width.
+         */
+        wc.x = e->x;
+        wc.y = e->y;
+        wc.width = e->width;
+        wc.height = e->height;
+        wc.sibling = e->sibling;
+        wc.stackmode = e->stack_mode;
+
+        configwin(e->window, e->value_mask, wc);
+    }
+}
+
+/*
+ * Add the values in ConfigureRequest earlier that isn't in later to
+ * later, so later does what both would have done.
+ */
+void mergeconfig(xcb_configure_request_event_t *later,
+                 const xcb_configure_request_event_t *earlier)
+{
+    uint16_t missing = earlier->value_mask & ~later->value_mask;
+
+    if (missing & XCB_CONFIG_WINDOW_X)
+    {
+        later->x = earlier->x;
+    }
+
+    if (missing & XCB_CONFIG_WINDOW_Y)
+    {
+        later->y = earlier->y;
+    }
+
+    if (missing & XCB_CONFIG_WINDOW_WIDTH)
+    {
+        later->width = earlier->width;
+    }
+
+    if (missing & XCB_CONFIG_WINDOW_HEIGHT)
+    {
+        later->height = earlier->height;
+    }
+
+    if (missing & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+    {
+        later->border_width = earlier->border_width;
+    }
+
+    later->value_mask |= missing;
+}
+
+/*
+ * Throw away buffered events that later events in the buffer make
+ * redundant.
+ *
+ * We walk the buffer backwards, remembering what kind of events we
+ * have already seen later on. We keep:
+ *
+ * - the last MotionNotify before every button press or release,
+ *
+ * - the last EnterNotify we would act on before every key or button
+ *   event,
+ *
+ * - the last RANDR screen change,
+ *
+ * - the last keyboard MappingNotify, since we read the entire keyboard
+ *   mapping again anyway,
+ *
+ * - the last ConfigureRequest for every window. Earlier requests for
+ *   the same window are merged into it unless they restack the
+ *   window. We don't merge over a MapRequest, UnmapNotify or
+ *   DestroyNotify for the window, since we treat the requests
+ *   differently before and after we manage the window.
+ */
+void coalesce(void)
+{
+    xcb_generic_event_t *ev;
+    bool seenmotion = false;
+    bool seenenter = false;
+    bool seenrandr = false;
+    bool seenmapping = false;
+    bool drop;
+    int i;
+
+    hashclear(&evbuf.configs);
+
+    for (i = evbuf.len - 1; i >= evbuf.next; i --)
+    {
+        ev = evbuf.evs[i];
+        drop = false;
+
+        if (ev->response_type == randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+        {
+            drop = seenrandr;
+            seenrandr = true;
+        }
+        else
+        {
+            switch (ev->response_type & ~0x80)
+            {
+            case XCB_MOTION_NOTIFY:
+                drop = seenmotion;
+                seenmotion = true;
+                break;
+
+            case XCB_BUTTON_PRESS:
+            case XCB_BUTTON_RELEASE:
+                seenmotion = false;
+                seenenter = false;
+                break;
+
+            case XCB_KEY_PRESS:
+            case XCB_KEY_RELEASE:
+                seenenter = false;
+                break;
+
+            case XCB_ENTER_NOTIFY:
+            {
+                xcb_enter_notify_event_t *e = (xcb_enter_notify_event_t *)ev;
+
+                if (e->mode == XCB_NOTIFY_MODE_NORMAL
+                    || e->mode == XCB_NOTIFY_MODE_UNGRAB)
+                {
+                    drop = seenenter;
+                    seenenter = true;
+                }
+            }
+            break;
+
+            case XCB_MAPPING_NOTIFY:
+            {
+                xcb_mapping_notify_event_t *e
+                    = (xcb_mapping_notify_event_t *)ev;
+
+                if (e->request == XCB_MAPPING_MODIFIER
+                    || e->request == XCB_MAPPING_KEYBOARD)
+                {
+                    drop = seenmapping;
+                    seenmapping = true;
+                }
+            }
+            break;
+
+            case XCB_CONFIGURE_REQUEST:
+            {
+                xcb_configure_request_event_t *e
+                    = (xcb_configure_request_event_t *)ev;
+                xcb_configure_request_event_t *later;
+
+                later = hashfind(&evbuf.configs, e->window);
+                if (NULL != later
+                    && !(e->value_mask & (XCB_CONFIG_WINDOW_SIBLING
+                                          | XCB_CONFIG_WINDOW_STACK_MODE)))
+                {
+                    mergeconfig(later, e);
+                    drop = true;
+                }
+                else if (NULL == later)
+                {
+                    hashadd(&evbuf.configs, e->window, e);
+                }
+            }
+            break;
+
+            case XCB_MAP_REQUEST:
+                hashdel(&evbuf.configs,
+                        ((xcb_map_request_event_t *)ev)->window);
+                break;
+
+            case XCB_UNMAP_NOTIFY:
+                hashdel(&evbuf.configs,
+                        ((xcb_unmap_notify_event_t *)ev)->window);
+                break;
+
+            case XCB_DESTROY_NOTIFY:
+                hashdel(&evbuf.configs,
+                        ((xcb_destroy_notify_event_t *)ev)->window);
+                break;
+            } /* switch */
+        }
+
+        if (drop)
+        {
+            free(ev);
+            evbuf.evs[i] = NULL;
+            evbuf.dropped ++;
+        }
+    }
+
+    hashclear(&evbuf.configs);
 }
 
-void deletewin(void)
+/*
+ * Put ev and every other event already waiting in XCB's queue in the
+ * event buffer. Then throw away what we don't need.
+ *
+ * The buffer must be empty when we're called.
+ */
+void bufferevents(xcb_generic_event_t *ev)
 {
-    xcb_get_property_cookie_t cookie;
-    xcb_icccm_get_wm_protocols_reply_t protocols;
-    bool use_delete = false;
-    uint32_t i;
+    xcb_generic_event_t **evs;
 
-    if (NULL == focuswin)
-    {
-        return;
-    }
+    evbuf.evs[0] = ev;
+    evbuf.next = 0;
+    evbuf.len = 1;
+    evbuf.received ++;
 
-    /* Check if WM_DELETE is supported.  */
-    cookie = xcb_icccm_get_wm_protocols_unchecked(conn, focuswin->id,
-                                                  wm_protocols);
-    if (xcb_icccm_get_wm_protocols_reply(conn, cookie, &protocols, NULL) == 1)
+    for (;;)
     {
-        for (i = 0; i < protocols.atoms_len; i++)
+        if (evbuf.len == evbuf.size)
         {
-            if (protocols.atoms[i] == wm_delete_window)
+            evs = realloc(evbuf.evs, evbuf.size * 2
+                          * sizeof (xcb_generic_event_t *));
+            if (NULL == evs)
             {
-                 use_delete = true;
+                /*
+                 * Handle what we have. The rest will wait in XCB's
+                 * queue.
+                 */
+                PDEBUG("Couldn't grow event buffer.\n");
+                break;
             }
+            evbuf.evs = evs;
+            evbuf.size *= 2;
         }
-    }
-
-    xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
 
-    if (use_delete)
-    {
-        xcb_client_message_event_t ev = {
-          .response_type = XCB_CLIENT_MESSAGE,
-          .format = 32,
-          .sequence = 0,
-          .window = focuswin->id,
-          .type = wm_protocols,
-          .data.data32 = { wm_delete_window, XCB_CURRENT_TIME }
-        };
+        ev = xcb_poll_for_queued_event(conn);
+        if (NULL == ev)
+        {
+            break;
+        }
 
-        xcb_send_event(conn, false, focuswin->id,
-                       XCB_EVENT_MASK_NO_EVENT, (char *) &ev);
+        evbuf.evs[evbuf.len] = ev;
+        evbuf.len ++;
+        evbuf.received ++;
     }
-    else
+
+    if (evbuf.len > 1)
     {
-        xcb_kill_client(conn, focuswin->id);
+        coalesce();
+        PDEBUG("Buffered %d events. %lu dropped in total.\n",
+               evbuf.len, evbuf.dropped);
     }
-
-    xcb_flush(conn);
 }
 
-void prevscreen(void)
+/*
+ * Get next event to handle, reading from the X server if we don't
+ * have any buffered.
+ *
+ * Returns event or NULL if there isn't any.
+ */
+xcb_generic_event_t *getevent(void)
 {
-    struct item *item;
-
-    if (NULL == focuswin || NULL == focuswin->monitor)
-    {
-        return;
-    }
-
-    item = focuswin->monitor->item->prev;
+    xcb_generic_event_t *ev;
 
-    if (NULL == item)
+    for (;;)
     {
-        return;
-    }
+        while (evbuf.next < evbuf.len)
+        {
+            ev = evbuf.evs[evbuf.next];
+            evbuf.next ++;
 
-    focuswin->monitor = item->data;
+            if (NULL != ev)
+            {
+                return ev;
+            }
+        }
 
-    raisewindow(focuswin->id);
-    fitonscreen(focuswin);
-    movelim(focuswin);
+        ev = xcb_poll_for_event(conn);
+        if (NULL == ev)
+        {
+            return NULL;
+        }
 
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     0, 0);
-    xcb_flush(conn);
+        bufferevents(ev);
+    }
 }
 
-void nextscreen(void)
+/*
+ * Call timer->func in msec milliseconds. If the timer was already
+ * set, forget about the old time.
+ */
+void settimer(struct timer *timer, uint32_t msec)
 {
     struct item *item;
 
-    if (NULL == focuswin || NULL == focuswin->monitor)
-    {
-        return;
-    }
+    deltimer(timer);
 
-    item = focuswin->monitor->item->next;
+    timer->expire = getmsec() + msec;
 
+    item = additem(&wheel[(timer->expire / TIMER_TICK) % TIMER_SLOTS]);
     if (NULL == item)
     {
+        PDEBUG("settimer: Out of memory.\n");
         return;
     }
 
-    focuswin->monitor = item->data;
-
-    raisewindow(focuswin->id);
-    fitonscreen(focuswin);
-    movelim(focuswin);
-
-    xcb_warp_pointer(conn, XCB_NONE, focuswin->id, 0, 0, 0, 0,
-                     0, 0);
-    xcb_flush(conn);
+    item->data = timer;
+    timer->item = item;
+    ntimers ++;
 }
 
-void handle_keypress(xcb_key_press_event_t *ev)
+/* Forget about timer. It's OK if it isn't set. */
+void deltimer(struct timer *timer)
 {
-    int i;
-    key_enum_t key;
-
-    for (key = KEY_MAX, i = KEY_F; i < KEY_MAX; i ++)
-    {
-        if (ev->detail == keys[i].keycode && 0 != keys[i].keycode)
-        {
-            key = i;
-            break;
-        }
-    }
-    if (key == KEY_MAX)
+    if (NULL == timer->item)
     {
-        PDEBUG("Unknown key pressed.\n");
-
-        /*
-         * We don't know what to do with this key. Send this key press
-         * event to the focused window.
-         */
-        xcb_send_event(conn, false, XCB_SEND_EVENT_DEST_ITEM_FOCUS,
-                       XCB_EVENT_MASK_NO_EVENT, (char *) ev);
-        xcb_flush(conn);
         return;
     }
 
-    if (MCWM_TABBING == mode && key != KEY_TAB && key != KEY_BACKTAB)
+    delitem(&wheel[(timer->expire / TIMER_TICK) % TIMER_SLOTS], timer->item);
+    timer->item = NULL;
+    ntimers --;
+}
+
+/* Call all timers that have expired. */
+void runtimers(void)
+{
+    uint64_t now;
+    uint64_t nowtick;
+    uint64_t tick;
+    struct item *item;
+    struct timer *timer;
+
+    now = getmsec();
+    nowtick = now / TIMER_TICK;
+
+    /* No need to go around the wheel more than once. */
+    if (nowtick - lasttick >= TIMER_SLOTS)
     {
-        /* First finish tabbing around. Then deal with the next key. */
-        finishtabbing();
+        lasttick = nowtick - TIMER_SLOTS + 1;
     }
 
-    /* Is it shifted? */
-    if (ev->state & SHIFTMOD)
+    for (tick = lasttick; tick <= nowtick && 0 != ntimers; tick ++)
     {
-        switch (key)
+        /*
+         * A timer function might set or delete other timers, so
+         * start over in the slot after every call.
+         */
+        for (item = wheel[tick % TIMER_SLOTS]; item != NULL;)
         {
-        case KEY_H: /* h */
-            resizestep(focuswin, 'h');
-            break;
-
-        case KEY_J: /* j */
-            resizestep(focuswin, 'j');
-            break;
-
-        case KEY_K: /* k */
-            resizestep(focuswin, 'k');
-            break;
-
-        case KEY_L: /* l */
-            resizestep(focuswin, 'l');
-            break;
-
-        case KEY_TAB: /* shifted tab counts as backtab */
-            focusnext(true);
-            break;
+            timer = item->data;
 
-        default:
-            /* Ignore other shifted keys. */
-            break;
+            if (timer->expire <= now)
+            {
+                deltimer(timer);
+                timer->func();
+                item = wheel[tick % TIMER_SLOTS];
+            }
+            else
+            {
+                item = item->next;
+            }
         }
     }
-    else
-    {
-        switch (key)
-        {
-        case KEY_RET: /* return */
-            start(conf.terminal);
-            break;
-
-        case KEY_F: /* f */
-            fixwindow(focuswin, true);
-            break;
-
-        case KEY_H: /* h */
-            movestep(focuswin, 'h');
-            break;
-
-        case KEY_J: /* j */
-            movestep(focuswin, 'j');
-            break;
-
-        case KEY_K: /* k */
-            movestep(focuswin, 'k');
-            break;
-
-        case KEY_L: /* l */
-            movestep(focuswin, 'l');
-            break;
-
-        case KEY_TAB: /* tab */
-            focusnext(false);
-            break;
-
-        case KEY_BACKTAB: /* backtab */
-            focusnext(true);
-            break;
-
-        case KEY_M: /* m */
-            maxvert(focuswin);
-            break;
-
-        case KEY_R: /* r*/
-            raiseorlower(focuswin);
-            break;
-
-        case KEY_X: /* x */
-            maximize(focuswin);
-            break;
-
-        case KEY_1:
-            changeworkspace(0);
-            break;
-
-        case KEY_2:
-            changeworkspace(1);
-            break;
-
-        case KEY_3:
-            changeworkspace(2);
-            break;
 
-        case KEY_4:
-            changeworkspace(3);
-            break;
+    lasttick = nowtick;
+}
 
-        case KEY_5:
-            changeworkspace(4);
-            break;
+/*
+ * Find out when the next timer expires.
+ *
+ * Returns time in ms or 0 if there are no timers. If no timer
+ * expires during this turn of the wheel we return the end of the turn
+ * and look again then.
+ */
+uint64_t nexttimer(void)
+{
+    uint64_t nowtick;
+    uint64_t tick;
+    uint64_t first = 0;
+    struct item *item;
+    struct timer *timer;
 
-        case KEY_6:
-            changeworkspace(5);
-            break;
+    if (0 == ntimers)
+    {
+        return 0;
+    }
 
-        case KEY_7:
-            changeworkspace(6);
-            break;
+    nowtick = getmsec() / TIMER_TICK;
 
-        case KEY_8:
-            changeworkspace(7);
-            break;
+    for (tick = nowtick; tick < nowtick + TIMER_SLOTS; tick ++)
+    {
+        for (item = wheel[tick % TIMER_SLOTS]; item != NULL;
+             item = item->next)
+        {
+            timer = item->data;
+            if (timer->expire / TIMER_TICK <= tick
+                && (0 == first || timer->expire < first))
+            {
+                first = timer->expire;
+            }
+        }
 
-        case KEY_9:
-            changeworkspace(8);
-            break;
+        if (0 != first)
+        {
+            return first;
+        }
+    }
 
-        case KEY_0:
-            changeworkspace(9);
-            break;
+    return tick * TIMER_TICK;
+}
 
-        case KEY_Y:
-            topleft();
-            break;
+/*
+ * Wait for fd in the event loop as well and call func when it's
+ * readable.
+ *
+ * Returns 0 on success.
+ */
+int addsource(int fd, void (*func)(int fd))
+{
+    if (MAXSOURCES == nsources)
+    {
+        return -1;
+    }
 
-        case KEY_U:
-            topright();
-            break;
+#ifdef __linux__
+    {
+        struct epoll_event event;
 
-        case KEY_B:
-            botleft();
-            break;
+        event.events = EPOLLIN;
+        event.data.ptr = &sources[nsources];
 
-        case KEY_N:
-            botright();
-            break;
+        if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event))
+        {
+            perror("mcwm: epoll_ctl");
+            return -1;
+        }
+    }
+#endif
 
-        case KEY_END:
-            deletewin();
-            break;
+    sources[nsources].fd = fd;
+    sources[nsources].func = func;
+    nsources ++;
 
-        case KEY_PREVSCR:
-            prevscreen();
-            break;
+    return 0;
+}
 
-        case KEY_NEXTSCR:
-            nextscreen();
-            break;
+/*
+ * The X connection is readable. Nothing to do here, events() will
+ * read the events.
+ */
+void readxcb(int fd)
+{
+    (void) fd;
+}
 
-        case KEY_ICONIFY:
-            if (conf.allowicons)
-            {
-                hide(focuswin);
-            }
-            break;
+#ifdef __linux__
 
-        case KEY_PREVWS:
-            if (curws > 0)
-            {
-                changeworkspace(curws - 1);
-            }
-            else
-            {
-                changeworkspace(WORKSPACES - 1);
-            }
+/* Handle the signals waiting on signalfd fd. */
+void readsignals(int fd)
+{
+    struct signalfd_siginfo info;
+
+    while (sizeof info == read(fd, &info, sizeof info))
+    {
+        switch (info.ssi_signo)
+        {
+        case SIGCHLD:
+            /* Don't create zombies. */
+            while (0 < waitpid(-1, NULL, WNOHANG))
+                ;
             break;
 
-        case KEY_NEXTWS:
-            changeworkspace((curws + 1) % WORKSPACES);
+        case SIGUSR1:
+            wantstats = 1;
             break;
 
         default:
-            /* Ignore other keys. */
+            sigcode = info.ssi_signo;
             break;
-        } /* switch unshifted */
+        }
     }
-} /* handle_keypress() */
+}
 
-/* Helper function to configure a window. */
-void configwin(xcb_window_t win, uint16_t mask, struct winconf wc)
+/* The timerfd fd fired. Run the timers. */
+void readtimer(int fd)
 {
-    uint32_t values[7];
-    int i = -1;
+    uint64_t expirations;
 
-    if (mask & XCB_CONFIG_WINDOW_X)
+    if (-1 == read(fd, &expirations, sizeof expirations))
     {
-        mask |= XCB_CONFIG_WINDOW_X;
-        i ++;
-        values[i] = wc.x;
+        PDEBUG("Spurious timer wakeup.\n");
     }
 
-    if (mask & XCB_CONFIG_WINDOW_Y)
-    {
-        mask |= XCB_CONFIG_WINDOW_Y;
-        i ++;
-        values[i] = wc.y;
-    }
+    timerarmed = 0;
+    runtimers();
+}
 
-    if (mask & XCB_CONFIG_WINDOW_WIDTH)
-    {
-        mask |= XCB_CONFIG_WINDOW_WIDTH;
-        i ++;
-        values[i] = wc.width;
-    }
+#endif /* __linux__ */
 
-    if (mask & XCB_CONFIG_WINDOW_HEIGHT)
+/*
+ * Set up everything the event loop waits for.
+ *
+ * Returns 0 on success.
+ */
+int setupevents(void)
+{
+#ifdef __linux__
+    sigset_t mask;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == epfd)
     {
-        mask |= XCB_CONFIG_WINDOW_HEIGHT;
-        i ++;
-        values[i] = wc.height;
+        perror("mcwm: epoll_create1");
+        return -1;
     }
 
-    if (mask & XCB_CONFIG_WINDOW_SIBLING)
+    /* The signals were blocked in main(). */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGUSR1);
+
+    sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (-1 == sigfd)
     {
-        mask |= XCB_CONFIG_WINDOW_SIBLING;
-        i ++;
-        values[i] = wc.sibling;
+        perror("mcwm: signalfd");
+        return -1;
     }
 
-    if (mask & XCB_CONFIG_WINDOW_STACK_MODE)
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == timerfd)
     {
-        mask |= XCB_CONFIG_WINDOW_STACK_MODE;
-        i ++;
-        values[i] = wc.stackmode;
+        perror("mcwm: timerfd_create");
+        return -1;
     }
 
-    if (-1 != i)
+    if (0 != addsource(sigfd, readsignals)
+        || 0 != addsource(timerfd, readtimer))
     {
-        xcb_configure_window(conn, win, mask, values);
-        xcb_flush(conn);
+        return -1;
     }
+#endif
+
+    lasttick = getmsec() / TIMER_TICK;
+
+    return addsource(xcb_get_file_descriptor(conn), readxcb);
 }
 
-void configurerequest(xcb_configure_request_event_t *e)
+/*
+ * Sleep until one of our sources is readable, a timer expires or we
+ * get a signal. Then handle what happened.
+ */
+void waitevents(void)
 {
-    struct client *client;
-    struct winconf wc;
-    int16_t mon_x;
-    int16_t mon_y;
-    uint16_t mon_width;
-    uint16_t mon_height;
+    uint64_t next;
+    int found;
+    int i;
 
-    PDEBUG("event: Configure request. mask = %d\n", e->value_mask);
+#ifdef __linux__
+    struct epoll_event ready[MAXSOURCES];
 
-    /* Find the client. */
-    if ((client = findclient(e->window)))
+    /* Arm timerfd for the first timer, unless it's already armed. */
+    next = nexttimer();
+    if (0 != next && next != timerarmed)
     {
-        /* Find monitor position and size. */
-        if (NULL == client || NULL == client->monitor)
+        struct itimerspec its;
+
+        /* Zero would disarm it. */
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000 + 1;
+        its.it_interval.tv_sec = 0;
+        its.it_interval.tv_nsec = 0;
+
+        if (0 == timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL))
         {
-            mon_x = 0;
-            mon_y = 0;
-            mon_width = screen->width_in_pixels;
-            mon_height = screen->height_in_pixels;
+            timerarmed = next;
         }
-        else
+    }
+
+    found = epoll_wait(epfd, ready, MAXSOURCES, -1);
+    if (-1 == found)
+    {
+        if (EINTR != errno)
         {
-            mon_x = client->monitor->x;
-            mon_y = client->monitor->y;
-            mon_width = client->monitor->width;
-            mon_height = client->monitor->height;
+            /* Something was seriously wrong with epoll_wait(). */
+            perror("mcwm: epoll_wait");
+            cleanup(0);
         }
+        return;
+    }
 
-#if 0
-        /*
-         * We ignore moves the user haven't initiated, that is do
-         * nothing on XCB_CONFIG_WINDOW_X and XCB_CONFIG_WINDOW_Y
-         * ConfigureRequests.
-         *
-         * Code here if we ever change our minds or if you, dear user,
-         * wants this functionality.
-         */
+    for (i = 0; i < found; i ++)
+    {
+        struct source *source = ready[i].data.ptr;
 
-        if (e->value_mask & XCB_CONFIG_WINDOW_X)
-        {
-            /* Don't move window if maximized. Don't move off the screen. */
-            if (!client->maxed && e->x > 0)
-            {
-                client->x = e->x;
-            }
-        }
+        source->func(source->fd);
+    }
+#else
+    fd_set in;
+    int maxfd = -1;
+    struct timeval tv;
+    struct timeval *timeout = NULL;
 
-        if (e->value_mask & XCB_CONFIG_WINDOW_Y)
+    FD_ZERO(&in);
+    for (i = 0; i < nsources; i ++)
+    {
+        FD_SET(sources[i].fd, &in);
+        if (sources[i].fd > maxfd)
         {
-            /*
-             * Don't move window if maximized. Don't move off the
-             * screen.
-             */
-            if (!client->maxed && !client->vertmaxed && e->y > 0)
-            {
-                client->y = e->y;
-            }
+            maxfd = sources[i].fd;
         }
-#endif
+    }
 
-        if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH)
+    next = nexttimer();
+    if (0 != next)
+    {
+        uint64_t now = getmsec();
+        uint64_t wait = next > now ? next - now : 0;
+
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+        timeout = &tv;
+    }
+
+    /* select() returns if we're interrupted by a signal. We like that. */
+    found = select(maxfd + 1, &in, NULL, NULL, timeout);
+    if (-1 == found)
+    {
+        if (EINTR != errno)
         {
-            /* Don't resize if maximized. */
-            if (!client->maxed)
-            {
-                client->width = e->width;
-            }
+            /* Something was seriously wrong with select(). */
+            fprintf(stderr, "mcwm: select failed.");
+            cleanup(0);
         }
+        return;
+    }
 
-        if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
+    for (i = 0; i < nsources; i ++)
+    {
+        if (FD_ISSET(sources[i].fd, &in))
         {
-            /* Don't resize if maximized. */
-            if (!client->maxed && !client->vertmaxed)
-            {
-                client->height = e->height;
-            }
+            sources[i].func(sources[i].fd);
         }
+    }
 
-        /*
-         * XXX Do we really need to pass on sibling and stack mode
-         * configuration? Do we want to?
-         */
-        if (e->value_mask & XCB_CONFIG_WINDOW_SIBLING)
-        {
-            uint32_t values[1];
+    runtimers();
+#endif
+}
 
-            values[0] = e->sibling;
-            xcb_configure_window(conn, e->window,
-                                 XCB_CONFIG_WINDOW_SIBLING,
-                                 values);
-            xcb_flush(conn);
+/* Find the statistics slot for event type. */
+int statindex(uint8_t type)
+{
+    if (-1 != randrbase && type >= randrbase
+        && type <= randrbase + XCB_RANDR_NOTIFY)
+    {
+        return STAT_RANDR;
+    }
 
-        }
+    if (type <= MAXEVENTS)
+    {
+        return type;
+    }
 
-        if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
-        {
-            uint32_t values[1];
+    return STAT_OTHER;
+}
 
-            values[0] = e->stack_mode;
-            xcb_configure_window(conn, e->window,
-                                 XCB_CONFIG_WINDOW_STACK_MODE,
-                                 values);
-            xcb_flush(conn);
-        }
+/*
+ * Remember that we handled an event of statistics slot type that
+ * we started on at start, in us. trips is the number of round trips
+ * made before we started.
+ */
+void statevent(int type, uint64_t start, unsigned long trips)
+{
+    struct evstat *stat = &evstats[type];
+    uint64_t usec;
+    uint64_t t;
+    int bucket;
 
-        /* Check if window fits on screen after resizing. */
+    usec = getusec() - start;
 
-        if (client->x + client->width + 2 * conf.borderwidth
-            > mon_x + mon_width)
-        {
-            /*
-             * See if it fits if we move away the window from the
-             * right edge of the screen.
-             */
-            client->x = mon_x + mon_width
-                - (client->width + 2 * conf.borderwidth);
+    for (bucket = 0, t = usec; t != 0 && bucket < STATBUCKETS - 1;
+         bucket ++)
+    {
+        t >>= 1;
+    }
 
-            /*
-             * If we moved over the left screen edge, move back and
-             * fit exactly on screen.
-             */
-            if (client->x < mon_x)
-            {
-                client->x = mon_x;
-                client->width = mon_width - 2 * conf.borderwidth;
-            }
+    stat->count ++;
+    stat->roundtrips += roundtrips - trips;
+    stat->total += usec;
+    if (usec > stat->max)
+    {
+        stat->max = usec;
+    }
+    stat->hist[bucket] ++;
+}
+
+/* Print event statistics on stderr. */
+void dumpstats(void)
+{
+    struct evstat *stat;
+    char *name;
+    int i;
+    int b;
+
+    fprintf(stderr, "mcwm: Event statistics. Times in us. Histogram "
+            "buckets are <1, <2, <4, ... us.\n");
+    fprintf(stderr, "%-18s %10s %10s %8s %8s  %s\n", "event", "count",
+            "roundtrips", "avg", "max", "histogram");
+
+    for (i = 0; i < STATTYPES; i ++)
+    {
+        stat = &evstats[i];
+        if (0 == stat->count)
+        {
+            continue;
         }
 
-        if (client->y + client->height + 2 * conf.borderwidth
-            > mon_y + mon_height)
+        if (STAT_RANDR == i)
         {
-            /*
-             * See if it fits if we move away the window from the
-             * bottom edge.
-             */
-            client->y = mon_y + mon_height
-                - (client->height + 2 * conf.borderwidth);
-
-            /*
-             * If we moved over the top screen edge, move back and fit
-             * on screen.
-             */
-            if (client->y < mon_y)
-            {
-                PDEBUG("over the edge: y < %d\n", mon_y);
-                client->y = mon_y;
-                client->height = mon_height - 2 * conf.borderwidth;
-            }
+            name = "RandR";
+        }
+        else if (STAT_OTHER == i)
+        {
+            name = "Other";
+        }
+        else if (0 == i)
+        {
+            name = "Error";
+        }
+        else
+        {
+            name = evnames[i];
         }
 
-        moveresize(client->id, client->x, client->y, client->width,
-                   client->height);
-    }
-    else
-    {
-        PDEBUG("We don't know about this window yet.\n");
-
-        /*
-         * Unmapped window. Just pass all options except border
-         * width.
-         */
-        wc.x = e->x;
-        wc.y = e->y;
-        wc.width = e->width;
-        wc.height = e->height;
-        wc.sibling = e->sibling;
-        wc.stackmode = e->stack_mode;
+        fprintf(stderr, "%-18s %10lu %10lu %8lu %8lu ", name, stat->count,
+                stat->roundtrips, (unsigned long) (stat->total / stat->count),
+                (unsigned long) stat->max);
 
-        configwin(e->window, e->value_mask, wc);
+        for (b = 0; b < STATBUCKETS; b ++)
+        {
+            fprintf(stderr, " %lu", stat->hist[b]);
+        }
+        fprintf(stderr, "\n");
     }
+
+    fprintf(stderr, "mcwm: %lu round trips in total.\n", roundtrips);
+    fprintf(stderr, "mcwm: %lu restacks sent, %lu skipped.\n", restacks,
+            norestacks);
+    fprintf(stderr, "mcwm: %lu monitor rescans, %lu skipped.\n", rescans,
+            norescans);
 }
 
 void events(void)
 {
     xcb_generic_event_t *ev;
+    int stattype;                   /* Statistics slot for event. */
+    uint64_t began;                 /* When we started handling it. */
+    unsigned long trips;            /* Round trips before handling it. */
 
     int16_t mode_x = 0;             /* X coord when in special mode */
     int16_t mode_y = 0;             /* Y coord when in special mode */
-    int fd;                         /* Our X file descriptor */
-    fd_set in;                      /* For select */
-    int found;                      /* Ditto. */
-
-    /* Get the file descriptor so we can do select() on it. */
-    fd = xcb_get_file_descriptor(conn);
 
     for (sigcode = 0; 0 == sigcode;)
     {
-        /* Prepare for select(). */
-        FD_ZERO(&in);
-        FD_SET(fd, &in);
+        /* Run any timers that expired while we were busy. */
+        if (0 != ntimers)
+        {
+            runtimers();
+        }
+
+        if (wantstats)
+        {
+            wantstats = 0;
+            dumpstats();
+        }
 
         /*
-         * Check for events, again and again. When poll returns NULL
-         * (and it does that a lot), we block on select() until the
-         * event file descriptor gets readable again.
-         *
-         * We do it this way instead of xcb_wait_for_event() since
-         * select() will return if we were interrupted by a signal. We
-         * like that.
+         * Check for events, again and again. When getevent() returns
+         * NULL (and it does that a lot), we sleep in waitevents()
+         * until something happens.
          */
-        ev = xcb_poll_for_event(conn);
+        ev = getevent();
         if (NULL == ev)
         {
-            PDEBUG("xcb_poll_for_event() returned NULL.\n");
+            PDEBUG("getevent() returned NULL.\n");
 
             /*
              * Check if we have an unrecoverable connection error,
@@ -3627,29 +6483,35 @@ void events(void)
                 exit(1);
             }
 
-            found = select(fd + 1, &in, NULL, NULL, NULL);
-            if (-1 == found)
-            {
-                if (EINTR == errno)
-                {
-                    /* We received a signal. Break out of loop. */
-                    break;
-                }
-                else
-                {
-                    /* Something was seriously wrong with select(). */
-                    fprintf(stderr, "mcwm: select failed.");
-                    cleanup(0);
-                    exit(1);
-                }
-            }
-            else
+            /*
+             * Nothing more to do right now. Send everything we have
+             * queued up while handling events in one go before we
+             * sleep.
+             *
+             * Flushing might read events while waiting to write, so
+             * check the queue again before blocking.
+             */
+            flushdesktops();
+            writestate();
+            xcb_flush(conn);
+
+            ev = xcb_poll_for_queued_event(conn);
+            if (NULL != ev)
             {
-                /* We found more events. Goto start of loop. */
+                bufferevents(ev);
                 continue;
             }
+
+            waitevents();
+
+            /* Goto start of loop. */
+            continue;
         }
 
+        stattype = statindex(ev->response_type & ~0x80);
+        began = getusec();
+        trips = roundtrips;
+
 #ifdef DEBUG
         if (ev->response_type <= MAXEVENTS)
         {
@@ -3661,12 +6523,20 @@ void events(void)
         }
 #endif
 
-        /* Note that we ignore XCB_RANDR_NOTIFY. */
+        /*
+         * Note that we ignore XCB_RANDR_NOTIFY unless we use RANDR
+         * 1.5 monitors. Then a changed output, CRTC or resource might
+         * mean changed monitors as well.
+         */
         if (ev->response_type
-            == randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+            == randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY
+            || (randrmonitors
+                && ev->response_type == randrbase + XCB_RANDR_NOTIFY))
         {
-            PDEBUG("RANDR screen change notify. Checking outputs.\n");
-            getrandr();
+            PDEBUG("RANDR screen change notify. Waiting for it to "
+                   "settle.\n");
+            screenchanged();
+            statevent(stattype, began, trips);
             free(ev);
             continue;
         }
@@ -3683,12 +6553,59 @@ void events(void)
         }
         break;
 
+        case XCB_CREATE_NOTIFY:
+        {
+            xcb_create_notify_event_t *e
+                = (xcb_create_notify_event_t *)ev;
+
+            /* New windows start on top. */
+            if (e->parent == screen->root)
+            {
+                stackadd(e->window);
+            }
+        }
+        break;
+
+        case XCB_REPARENT_NOTIFY:
+        {
+            xcb_reparent_notify_event_t *e
+                = (xcb_reparent_notify_event_t *)ev;
+
+            if (e->parent == screen->root)
+            {
+                stackadd(e->window);
+            }
+            else
+            {
+                stackdel(e->window);
+            }
+        }
+        break;
+
+        case XCB_CIRCULATE_NOTIFY:
+        {
+            xcb_circulate_notify_event_t *e
+                = (xcb_circulate_notify_event_t *)ev;
+
+            if (XCB_PLACE_ON_TOP == e->place)
+            {
+                stackadd(e->window);
+            }
+            else
+            {
+                stackabove(e->window, XCB_NONE);
+            }
+        }
+        break;
+
         case XCB_DESTROY_NOTIFY:
         {
             xcb_destroy_notify_event_t *e;
 
             e = (xcb_destroy_notify_event_t *) ev;
 
+            stackdel(e->window);
+
             /*
              * If we had focus or our last focus in this window,
              * forget about the focus.
@@ -3825,16 +6742,26 @@ void events(void)
                  * and confine it to root.
                  *
                  * Give us events when the key is released or if
-                 * any motion occurs with the key held down.
+                 * any motion occurs with the key held down. We want
+                 * real motion events with coordinates, not just
+                 * hints, so we never have to ask for the pointer
+                 * position while dragging.
                  *
                  * Keep updating everything else.
                  *
                  * Don't use any new cursor.
                  */
+                drag.pending = false;
+                drag.last = 0;
+
+                if (conf.snapmargin > 0)
+                {
+                    buildsnap(focuswin);
+                }
+
                 xcb_grab_pointer(conn, 0, screen->root,
                                  XCB_EVENT_MASK_BUTTON_RELEASE
-                                 | XCB_EVENT_MASK_BUTTON_MOTION
-                                 | XCB_EVENT_MASK_POINTER_MOTION_HINT,
+                                 | XCB_EVENT_MASK_BUTTON_MOTION,
                                  XCB_GRAB_MODE_ASYNC,
                                  XCB_GRAB_MODE_ASYNC,
                                  screen->root,
@@ -3850,7 +6777,7 @@ void events(void)
 
         case XCB_MOTION_NOTIFY:
         {
-            xcb_query_pointer_reply_t *pointer;
+            xcb_motion_notify_event_t *e = (xcb_motion_notify_event_t *)ev;
 
             /*
              * We can't do anything if we don't have a focused window
@@ -3862,37 +6789,20 @@ void events(void)
             }
 
             /*
-             * This is not really a real notify, but just a hint that
-             * the mouse pointer moved. This means we need to get the
-             * current pointer position ourselves.
+             * Note that any other motion events that were waiting
+             * have already been thrown away by coalesce(), so this
+             * is the latest position.
              */
-            pointer = xcb_query_pointer_reply(
-                conn, xcb_query_pointer(conn, screen->root), 0);
-
-            if (NULL == pointer)
-            {
-                PDEBUG("Couldn't get pointer position.\n");
-                break;
-            }
 
             /*
              * Our pointer is moving and since we even get this event
              * we're either resizing or moving a window.
              */
-            if (mode == MCWM_MOVE)
-            {
-                mousemove(focuswin, pointer->root_x, pointer->root_y);
-            }
-            else if (mode == MCWM_RESIZE)
-            {
-                mouseresize(focuswin, pointer->root_x, pointer->root_y);
-            }
-            else
-            {
-                PDEBUG("Motion event when we're not moving our resizing!\n");
-            }
+            drag.x = e->root_x;
+            drag.y = e->root_y;
+            drag.pending = true;
 
-            free(pointer);
+            dragupdate(focuswin, false);
         }
 
         break;
@@ -3931,6 +6841,13 @@ void events(void)
                     break;
                 }
 
+                /* Catch up with any motion we skipped. */
+                if (!focuswin->maxed)
+                {
+                    dragupdate(focuswin, true);
+                }
+                deltimer(&drag.timer);
+
                 /*
                  * We will get an EnterNotify and focus another window
                  * if the pointer just happens to be on top of another
@@ -4070,14 +6987,17 @@ void events(void)
                              * list and then the new focus to the head
                              * of the list.
                              */
-                            if (NULL != focuswin)
+                            if (NULL != focuswin && NULL != focuswin->wsitem)
                             {
-                                movetohead(&wslist[curws],
-                                           focuswin->wsitem[curws]);
+                                movetohead(wslistof(focuswin),
+                                           focuswin->wsitem);
                                 lastfocuswin = NULL;
                             }
 
-                            movetohead(&wslist[curws], client->wsitem[curws]);
+                            if (NULL != client->wsitem)
+                            {
+                                movetohead(wslistof(client), client->wsitem);
+                            }
                         }
 
                         setfocus(client);
@@ -4093,7 +7013,28 @@ void events(void)
             xcb_configure_notify_event_t *e
                 = (xcb_configure_notify_event_t *)ev;
 
-            if (e->window == screen->root)
+            if (e->window != screen->root)
+            {
+                struct client *client;
+
+                /* A window on the root might have been restacked. */
+                if (e->event == screen->root)
+                {
+                    stackabove(e->window, e->above_sibling);
+                }
+
+                /* If a window moved, the free space around it changed. */
+                client = findclient(e->window);
+                if (NULL != client && NULL != client->wsitem
+                    && (e->x != client->placed.x || e->y != client->placed.y
+                        || e->width != client->placed.width
+                        || e->height != client->placed.height))
+                {
+                    givespace(client);
+                    usespace(client);
+                }
+            }
+            else
             {
                 /*
                  * When using RANDR or Xinerama, the root can change
@@ -4119,18 +7060,20 @@ void events(void)
                 {
                     screen->width_in_pixels = e->width;
                     screen->height_in_pixels = e->height;
+                    stalespace(&rootws);
 
                     /* Check for RANDR. */
                     if (-1 == randrbase)
                     {
                         /* We have no RANDR so we rearrange windows to
-                         * the new root geometry here.
+                         * the new root geometry, or ask Xinerama for
+                         * new monitors, when it settles.
                          *
                          * With RANDR enabled, we handle this per
-                         * screen getrandr() when we receive an
+                         * screen in getrandr() when we receive an
                          * XCB_RANDR_SCREEN_CHANGE_NOTIFY event.
                          */
-                        arrangewindows();
+                        screenchanged();
                     }
                 }
             }
@@ -4159,7 +7102,6 @@ void events(void)
                     xcb_unmap_window(conn, e->window);
                     xcb_change_property(conn, XCB_PROP_MODE_REPLACE, e->window,
                                         wm_state, wm_state, 32, 2, data);
-                    xcb_flush(conn);
                 }
             }
         }
@@ -4214,48 +7156,48 @@ void events(void)
         {
             xcb_unmap_notify_event_t *e =
                 (xcb_unmap_notify_event_t *)ev;
-            struct item *item;
             struct client *client;
 
             /*
-             * Find the window in our *current* workspace list, then
-             * forget about it. If it gets mapped, we add it to our
-             * lists again then.
+             * Forget about the window unless we unmapped it
+             * ourselves with unmapwin(). If it gets mapped, we add it
+             * to our lists again then.
              *
              * Note that we might not know about the window we got the
-             * UnmapNotify event for. It might be a window we just
-             * unmapped on *another* workspace when changing
-             * workspaces, for instance, or it might be a window with
+             * UnmapNotify event for. It might be a window with
              * override redirect set. This is not an error.
              *
-             * XXX We might need to look in the global window list,
-             * after all. Consider if a window is unmapped on our last
-             * workspace while changing workspaces... If we do this,
-             * we need to keep track of our own windows and ignore
-             * UnmapNotify on them.
+             * A synthetic UnmapNotify means the client withdraws the
+             * window, perhaps while it's unmapped on another
+             * workspace. Always forget about it.
              */
-            for (item = wslist[curws]; item != NULL; item = item->next)
+            client = findclient(e->window);
+            if (NULL == client)
             {
-                client = item->data;
+                break;
+            }
 
-                if (client->id == e->window)
-                {
-                    PDEBUG("Forgetting about %d\n", e->window);
-                    if (focuswin == client)
-                    {
-                        focuswin = NULL;
-                    }
+            if (!(e->response_type & 0x80) && client->unmaps > 0)
+            {
+                PDEBUG("Ignoring our own unmap of %d\n", e->window);
+                client->unmaps --;
+                break;
+            }
 
-                    forgetclient(client);
-                    /* We're finished. Break out of for loop. */
-                    break;
-                }
+            PDEBUG("Forgetting about %d\n", e->window);
+            if (focuswin == client)
+            {
+                focuswin = NULL;
             }
+
+            forgetclient(client);
         }
         break;
 
         }
 
+        statevent(stattype, began, trips);
+
         /* Forget about this event. */
         free(ev);
     }
@@ -4263,45 +7205,119 @@ void events(void)
 
 void printhelp(void)
 {
-    printf("mcwm: Usage: mcwm [-b] [-s snapmargin] [-t terminal-program] "
-           "[-f colour] [-u colour] [-x colour] \n");
+    printf("mcwm: Usage: mcwm [-b] [-s snapmargin] [-r rate] "
+           "[-t terminal-program] [-f colour] [-u colour] [-x colour] "
+           "[-w workspaces] [-S msec]\n");
     printf("  -b means draw no borders\n");
     printf("  -s snapmargin in pixels\n");
+    printf("  -r rate limits window updates when dragging to rate per "
+           "second\n");
     printf("  -t urxvt will start urxvt when MODKEY + Return is pressed\n");
     printf("  -f colour sets colour for focused window borders of focused "
            "to a named color.\n");
     printf("  -u colour sets colour for unfocused window borders.\n");
     printf("  -x color sets colour for fixed window borders.\n");
+    printf("  -w workspaces sets the number of workspaces\n");
+    printf("  -S msec waits msec after the last monitor change before "
+           "rearranging windows\n");
+    printf("  Colours are names or hexadecimal, like #ff8800.\n");
+}
+
+/* Get a monotonic time stamp in milliseconds. */
+uint64_t getmsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Get a monotonic time stamp in microseconds. */
+uint64_t getusec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Get the reply to request sequence. All replies go through here so
+ * we count a round trip only when we really have to wait: replies to
+ * requests sent together have mostly arrived by the time we've read
+ * the first one.
+ */
+void *waitreply(unsigned int sequence, xcb_generic_error_t **error)
+{
+    void *reply = NULL;
+
+    if (xcb_poll_for_reply(conn, sequence, &reply, error))
+    {
+        return reply;
+    }
+
+    roundtrips ++;
+
+    return xcb_wait_for_reply(conn, sequence, error);
+}
+
+/* Wait until we know if the request behind cookie failed. */
+xcb_generic_error_t *checkrequest(xcb_void_cookie_t cookie)
+{
+    roundtrips ++;
+
+    return xcb_request_check(conn, cookie);
 }
 
+#ifndef __linux__
 void sigcatch(int sig)
 {
+    if (SIGUSR1 == sig)
+    {
+        wantstats = 1;
+        return;
+    }
+
     sigcode = sig;
 }
+#endif
 
 /*
- * Get a defined atom from the X server.
+ * Get all atoms in atomdefs from the X server. We send all requests
+ * before waiting for any reply so it costs only one round trip.
  */
-xcb_atom_t getatom(char *atom_name)
+void getatoms(void)
 {
-    xcb_intern_atom_cookie_t atom_cookie;
-    xcb_atom_t atom;
+    xcb_intern_atom_cookie_t cookies[sizeof atomdefs / sizeof atomdefs[0]];
     xcb_intern_atom_reply_t *rep;
+    unsigned i;
 
-    atom_cookie = xcb_intern_atom(conn, 0, strlen(atom_name), atom_name);
-    rep = xcb_intern_atom_reply(conn, atom_cookie, NULL);
-    if (NULL != rep)
+    for (i = 0; i < sizeof atomdefs / sizeof atomdefs[0]; i ++)
     {
-        atom = rep->atom;
-        free(rep);
-        return atom;
+        cookies[i] = xcb_intern_atom(conn, 0, strlen(atomdefs[i].name),
+                                     atomdefs[i].name);
     }
 
-    /*
-     * XXX Note that we return 0 as an atom if anything goes wrong.
-     * Might become interesting.
-     */
-    return 0;
+    for (i = 0; i < sizeof atomdefs / sizeof atomdefs[0]; i ++)
+    {
+        rep = waitreply(cookies[i].sequence, NULL);
+        if (NULL != rep)
+        {
+            *atomdefs[i].atom = rep->atom;
+            free(rep);
+        }
+        else
+        {
+            /*
+             * XXX Note that we use 0 as an atom if anything goes
+             * wrong. Might become interesting.
+             */
+            PDEBUG("Couldn't get atom %s.\n", atomdefs[i].name);
+            *atomdefs[i].atom = 0;
+        }
+    }
 }
 
 int main(int argc, char **argv)
@@ -4320,6 +7336,27 @@ int main(int argc, char **argv)
 
     /* Install signal handlers. */
 
+#ifdef __linux__
+    {
+        sigset_t mask;
+
+        /*
+         * Block the signals we handle. We read them from a signalfd
+         * in the event loop instead. See setupevents().
+         */
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGCHLD);
+        sigaddset(&mask, SIGUSR1);
+
+        if (-1 == sigprocmask(SIG_BLOCK, &mask, NULL))
+        {
+            perror("mcwm: sigprocmask");
+            exit(1);
+        }
+    }
+#else
     /* We ignore child exists. Don't create zombies. */
     if (SIG_ERR == signal(SIGCHLD, SIG_IGN))
     {
@@ -4339,19 +7376,30 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    if (SIG_ERR == signal(SIGUSR1, sigcatch))
+    {
+        perror("mcwm: signal");
+        exit(1);
+    }
+#endif
+
     /* Set up defaults. */
 
     conf.borderwidth = BORDERWIDTH;
     conf.snapmargin = SNAPMARGIN;
+    conf.dragrate = DRAGRATE;
     conf.terminal = TERMINAL;
     conf.allowicons = ALLOWICONS;
+    conf.workspaces = WORKSPACES;
+    conf.atomicswitch = ATOMICSWITCH;
+    conf.settle = SETTLETIME;
     focuscol = FOCUSCOL;
     unfocuscol = UNFOCUSCOL;
     fixedcol = FIXEDCOL;
 
     while (1)
     {
-        ch = getopt(argc, argv, "b:s:it:f:u:x:");
+        ch = getopt(argc, argv, "b:s:r:it:f:u:x:w:S:");
         if (-1 == ch)
         {
 
@@ -4371,6 +7419,22 @@ int main(int argc, char **argv)
             conf.snapmargin = atoi(optarg);
             break;
 
+        case 'r':
+            /* Drag rate */
+            if (atoi(optarg) < 0)
+            {
+                printhelp();
+                exit(1);
+            }
+            conf.dragrate = atoi(optarg);
+
+            /* We count in ms, so we can't wait less than one. */
+            if (conf.dragrate > 1000)
+            {
+                conf.dragrate = 1000;
+            }
+            break;
+
         case 'i':
             conf.allowicons = true;
             break;
@@ -4391,6 +7455,26 @@ int main(int argc, char **argv)
             fixedcol = optarg;
             break;
 
+        case 'w':
+            /* Number of workspaces. */
+            if (atoi(optarg) < 1)
+            {
+                printhelp();
+                exit(1);
+            }
+            conf.workspaces = atoi(optarg);
+            break;
+
+        case 'S':
+            /* Screen change settle time. */
+            if (atoi(optarg) < 0)
+            {
+                printhelp();
+                exit(1);
+            }
+            conf.settle = atoi(optarg);
+            break;
+
         default:
             printhelp();
             exit(0);
@@ -4429,20 +7513,65 @@ int main(int argc, char **argv)
            screen->height_in_pixels, screen->root);
 
     /* Get some colours. */
-    conf.focuscol = getcolor(focuscol);
-    conf.unfocuscol = getcolor(unfocuscol);
-    conf.fixedcol = getcolor(fixedcol);
+    {
+        struct colordef cols[] =
+        {
+            { focuscol, &conf.focuscol },
+            { unfocuscol, &conf.unfocuscol },
+            { fixedcol, &conf.fixedcol }
+        };
+
+        getcolors(cols, sizeof cols / sizeof cols[0]);
+    }
+
+    /* Get all atoms. */
+    getatoms();
+
+    /* Workspace lists used when we have no monitors. */
+    if (0 != initwsset(&rootws))
+    {
+        fprintf(stderr, "mcwm: Out of memory.\n");
+        xcb_disconnect(conn);
+        exit(1);
+    }
+
+    /* Tell everyone how many workspaces we have. */
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, screen->root,
+                        atom_numdesktops, XCB_ATOM_CARDINAL, 32, 1,
+                        &conf.workspaces);
+
+    /* Event buffer. */
+    evbuf.size = 64;
+    evbuf.evs = calloc(evbuf.size, sizeof (xcb_generic_event_t *));
+    if (NULL == evbuf.evs)
+    {
+        fprintf(stderr, "mcwm: Out of memory.\n");
+        xcb_disconnect(conn);
+        exit(1);
+    }
 
-    /* Get some atoms. */
-    atom_desktop = getatom("_NET_WM_DESKTOP");
-    wm_delete_window = getatom("WM_DELETE_WINDOW");
-    wm_change_state = getatom("WM_CHANGE_STATE");
-    wm_state = getatom("WM_STATE");
-    wm_protocols = getatom("WM_PROTOCOLS");
+    /* Index of all clients and of the stacking order. */
+    if (0 != hashinit(&clienttab, 0) || 0 != hashinit(&stacktab, 0))
+    {
+        fprintf(stderr, "mcwm: Out of memory.\n");
+        xcb_disconnect(conn);
+        exit(1);
+    }
+
+    settletimer.func = screensettled;
 
     /* Check for RANDR extension and configure. */
     randrbase = setuprandr();
 
+    /*
+     * Without RANDR, or with one too old or with no monitors to tell
+     * us about, Xinerama might still know about monitors.
+     */
+    if (-1 == randrbase || NULL == monlist)
+    {
+        xinerama = setupxinerama();
+    }
+
     /* Loop over all clients and set up stuff. */
     if (0 != setupscreen())
     {
@@ -4488,7 +7617,7 @@ int main(int argc, char **argv)
 
     cookie =
         xcb_change_window_attributes_checked(conn, root, mask, values);
-    error = xcb_request_check(conn, cookie);
+    error = checkrequest(cookie);
 
     xcb_flush(conn);
 
@@ -4504,6 +7633,17 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    /* Now that we hear about all restacking, see where everything is. */
+    initstack();
+
+    /* Set up what we wait for in the event loop. */
+    if (0 != setupevents())
+    {
+        fprintf(stderr, "mcwm: Couldn't set up event loop. Exiting.\n");
+        xcb_disconnect(conn);
+        exit(1);
+    }
+
     /* Loop over events. */
     events();
 
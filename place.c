@@ -0,0 +1,1146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "place.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif
+
+#ifdef DEBUG
+#define PDEBUG(Args...) \
+  do { fprintf(stderr, "mcwm: "); fprintf(stderr, ##Args); } while(0)
+#define D(x) x
+#else
+#define PDEBUG(Args...)
+#define D(x)
+#endif
+
+static int overlaps(const struct area *a, const struct area *b)
+{
+    return a->x < b->x + b->width && b->x < a->x + a->width
+        && a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+/* Check if a is completely inside b. */
+static int inside(const struct area *a, const struct area *b)
+{
+    return a->x >= b->x && a->y >= b->y
+        && a->x + a->width <= b->x + b->width
+        && a->y + a->height <= b->y + b->height;
+}
+
+/* Size class of a width or height. */
+static int sizeclass(int32_t size)
+{
+    int class;
+
+    for (class = 0; size > 1 && class < SPACECLASSES - 1; class ++)
+    {
+        size >>= 1;
+    }
+
+    return class;
+}
+
+/*
+ * Grid cell column or row of position pos, with cells cell large and
+ * num of them in a row.
+ */
+static int32_t gridcell(int32_t pos, int32_t cell, int32_t num)
+{
+    if (pos < 0)
+    {
+        return 0;
+    }
+
+    pos /= cell;
+
+    return pos < num ? pos : num - 1;
+}
+
+/* Find the grid cells area overlaps on a level of the grid. */
+static void gridrange(const struct freespace *space, int level,
+                      const struct area *area, int32_t *col0, int32_t *row0,
+                      int32_t *col1, int32_t *row1)
+{
+    int32_t num = SPACEGRID >> level;
+    int32_t width = space->cellwidth << level;
+    int32_t height = space->cellheight << level;
+
+    *col0 = gridcell(area->x - space->bounds.x, width, num);
+    *row0 = gridcell(area->y - space->bounds.y, height, num);
+    *col1 = gridcell(area->x + area->width - 1 - space->bounds.x, width, num);
+    *row1 = gridcell(area->y + area->height - 1 - space->bounds.y, height,
+                     num);
+}
+
+/* Grid cell col, row on a level of the grid. */
+static struct spacecell *gridat(struct freespace *space, int level,
+                                int32_t col, int32_t row)
+{
+    int32_t first = 0;
+    int i;
+
+    for (i = 0; i < level; i ++)
+    {
+        first += (SPACEGRID >> i) * (SPACEGRID >> i);
+    }
+
+    return &space->cells[first + row * (SPACEGRID >> level) + col];
+}
+
+/*
+ * Make room for at least num things of size each in *buf, which has
+ * room for *bufsize.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int grow(void **buf, uint32_t *bufsize, uint32_t num, size_t size)
+{
+    void *new;
+    uint32_t newsize;
+
+    if (num <= *bufsize)
+    {
+        return 0;
+    }
+
+    for (newsize = 0 == *bufsize ? 32 : *bufsize; newsize < num;
+         newsize *= 2)
+        ;
+
+    new = realloc(*buf, newsize * size);
+    if (NULL == new)
+    {
+        return -1;
+    }
+
+    *buf = new;
+    *bufsize = newsize;
+
+    return 0;
+}
+
+/*
+ * Get an unused slot for a rectangle.
+ *
+ * Returns slot or -1 if out of memory.
+ */
+static int32_t newslot(struct freespace *space)
+{
+    void *rects = space->rects;
+    uint32_t old = space->size;
+    uint32_t i;
+    int32_t id;
+
+    if (-1 == space->unused)
+    {
+        if (0 != grow(&rects, &space->size, old + 1,
+                      sizeof (struct freerect)))
+        {
+            return -1;
+        }
+
+        space->rects = rects;
+
+        for (i = old; i < space->size; i ++)
+        {
+            space->rects[i].live = false;
+            space->rects[i].seen = 0;
+            space->rects[i].next = i + 1 < space->size ? (int32_t) i + 1 : -1;
+        }
+
+        space->unused = old;
+    }
+
+    id = space->unused;
+    space->unused = space->rects[id].next;
+
+    return id;
+}
+
+/*
+ * Start a new walk over the free rectangles, so we can tell which ones
+ * we've seen.
+ */
+static void newstamp(struct freespace *space)
+{
+    uint32_t i;
+
+    if (0 == ++ space->stamp)
+    {
+        for (i = 0; i < space->size; i ++)
+        {
+            space->rects[i].seen = 0;
+        }
+        space->stamp = 1;
+    }
+}
+
+/* Forget the free rectangle in slot id. */
+static void delrect(struct freespace *space, int32_t id)
+{
+    struct freerect *rect = &space->rects[id];
+    struct spacecell *cell;
+    int32_t col0;
+    int32_t row0;
+    int32_t col1;
+    int32_t row1;
+    int32_t col;
+    int32_t row;
+    uint32_t i;
+
+    if (-1 != rect->prev)
+    {
+        space->rects[rect->prev].next = rect->next;
+    }
+    else
+    {
+        space->classes[rect->class] = rect->next;
+    }
+
+    if (-1 != rect->next)
+    {
+        space->rects[rect->next].prev = rect->prev;
+    }
+
+    gridrange(space, rect->level, &rect->area, &col0, &row0, &col1, &row1);
+    for (row = row0; row <= row1; row ++)
+    {
+        for (col = col0; col <= col1; col ++)
+        {
+            cell = gridat(space, rect->level, col, row);
+            for (i = 0; i < cell->num; i ++)
+            {
+                if ((int32_t) cell->ids[i] == id)
+                {
+                    cell->ids[i] = cell->ids[-- cell->num];
+                    break;
+                }
+            }
+        }
+    }
+
+    rect->live = false;
+    rect->next = space->unused;
+    space->unused = id;
+    space->num --;
+}
+
+/*
+ * Store area as a free rectangle.
+ *
+ * Returns its slot or -1 if out of memory.
+ */
+static int32_t addrect(struct freespace *space, const struct area *area)
+{
+    struct freerect *rect;
+    struct spacecell *cell;
+    void *ids;
+    int32_t id;
+    int32_t col0;
+    int32_t row0;
+    int32_t col1;
+    int32_t row1;
+    int32_t col;
+    int32_t row;
+
+    id = newslot(space);
+    if (-1 == id)
+    {
+        return -1;
+    }
+
+    rect = &space->rects[id];
+    rect->area = *area;
+    rect->live = true;
+    rect->class = sizeclass(area->width) * SPACECLASSES
+        + sizeclass(area->height);
+    rect->prev = -1;
+    rect->next = space->classes[rect->class];
+    if (-1 != rect->next)
+    {
+        space->rects[rect->next].prev = id;
+    }
+    space->classes[rect->class] = id;
+    space->num ++;
+
+    /*
+     * Put it on the finest level of the grid where it's in at most two
+     * cells each way, so large rectangles don't take many cells.
+     */
+    for (rect->level = 0; ; rect->level ++)
+    {
+        gridrange(space, rect->level, area, &col0, &row0, &col1, &row1);
+        if (col1 - col0 < 2 && row1 - row0 < 2)
+        {
+            break;
+        }
+    }
+
+    for (row = row0; row <= row1; row ++)
+    {
+        for (col = col0; col <= col1; col ++)
+        {
+            cell = gridat(space, rect->level, col, row);
+            ids = cell->ids;
+            if (0 != grow(&ids, &cell->size, cell->num + 1,
+                          sizeof (uint32_t)))
+            {
+                /* delrect() skips the cells it isn't in. */
+                delrect(space, id);
+                return -1;
+            }
+            cell->ids = ids;
+            cell->ids[cell->num ++] = id;
+        }
+    }
+
+    return id;
+}
+
+/*
+ * Find all free rectangles overlapping area and put their slots in
+ * space->hits from start on.
+ *
+ * Returns the number found or -1 if out of memory.
+ */
+static int32_t search(struct freespace *space, const struct area *area,
+                      uint32_t start)
+{
+    struct spacecell *cell;
+    struct freerect *rect;
+    void *hits;
+    uint32_t num = 0;
+    int32_t col0;
+    int32_t row0;
+    int32_t col1;
+    int32_t row1;
+    int32_t col;
+    int32_t row;
+    uint32_t i;
+    int level;
+
+    newstamp(space);
+
+    for (level = 0; level < SPACELEVELS; level ++)
+    {
+        gridrange(space, level, area, &col0, &row0, &col1, &row1);
+        for (row = row0; row <= row1; row ++)
+        {
+            for (col = col0; col <= col1; col ++)
+            {
+                cell = gridat(space, level, col, row);
+                for (i = 0; i < cell->num; i ++)
+                {
+                    rect = &space->rects[cell->ids[i]];
+                    if (rect->seen == space->stamp
+                        || !overlaps(&rect->area, area))
+                    {
+                        continue;
+                    }
+                    rect->seen = space->stamp;
+
+                    hits = space->hits;
+                    if (0 != grow(&hits, &space->hitsize, start + num + 1,
+                                  sizeof (uint32_t)))
+                    {
+                        return -1;
+                    }
+                    space->hits = hits;
+                    space->hits[start + num ++] = cell->ids[i];
+                }
+            }
+        }
+    }
+
+    return num;
+}
+
+/* Check if area is inside a free rectangle. */
+static int covered(struct freespace *space, const struct area *area)
+{
+    const struct spacecell *cell;
+    struct area corner;
+    int32_t col;
+    int32_t row;
+    int32_t dummy;
+    uint32_t i;
+    int level;
+
+    /*
+     * A free rectangle area is inside has area's corner in its cells,
+     * so we only look at one cell on each level.
+     */
+    corner.x = area->x;
+    corner.y = area->y;
+    corner.width = 1;
+    corner.height = 1;
+
+    for (level = 0; level < SPACELEVELS; level ++)
+    {
+        gridrange(space, level, &corner, &col, &row, &dummy, &dummy);
+        cell = gridat(space, level, col, row);
+        for (i = 0; i < cell->num; i ++)
+        {
+            if (inside(area, &space->rects[cell->ids[i]].area))
+            {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Add area to the free space unless it's inside a free rectangle
+ * already. Free rectangles inside area are thrown away.
+ *
+ * Returns 1 if added, 0 if not needed or -1 if out of memory.
+ */
+static int addfree(struct freespace *space, const struct area *area)
+{
+    int32_t num;
+    int32_t i;
+
+    if (area->width <= 0 || area->height <= 0 || covered(space, area))
+    {
+        return 0;
+    }
+
+    num = search(space, area, 0);
+    if (-1 == num)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < num; i ++)
+    {
+        if (inside(&space->rects[space->hits[i]].area, area))
+        {
+            delrect(space, space->hits[i]);
+        }
+    }
+
+    if (-1 == addrect(space, area))
+    {
+        return -1;
+    }
+
+    return 1;
+}
+
+/*
+ * Split rect around used into the at most four largest rectangles in
+ * rect that don't overlap used. Stores them in split.
+ *
+ * Returns the number of rectangles.
+ */
+static int splitrect(const struct area *rect, const struct area *used,
+                     struct area *split)
+{
+    int num = 0;
+
+    if (used->x > rect->x)
+    {
+        split[num].x = rect->x;
+        split[num].y = rect->y;
+        split[num].width = used->x - rect->x;
+        split[num].height = rect->height;
+        num ++;
+    }
+
+    if (used->x + used->width < rect->x + rect->width)
+    {
+        split[num].x = used->x + used->width;
+        split[num].y = rect->y;
+        split[num].width = rect->x + rect->width - (used->x + used->width);
+        split[num].height = rect->height;
+        num ++;
+    }
+
+    if (used->y > rect->y)
+    {
+        split[num].x = rect->x;
+        split[num].y = rect->y;
+        split[num].width = rect->width;
+        split[num].height = used->y - rect->y;
+        num ++;
+    }
+
+    if (used->y + used->height < rect->y + rect->height)
+    {
+        split[num].x = rect->x;
+        split[num].y = used->y + used->height;
+        split[num].width = rect->width;
+        split[num].height = rect->y + rect->height - (used->y + used->height);
+        num ++;
+    }
+
+    return num;
+}
+
+/*
+ * Put area last on space->queue, which holds *num areas.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int enqueue(struct freespace *space, const struct area *area,
+                   uint32_t *num)
+{
+    void *queue = space->queue;
+
+    if (0 != grow(&queue, &space->queuesize, *num + 1, sizeof (struct area)))
+    {
+        return -1;
+    }
+
+    space->queue = queue;
+    space->queue[(*num) ++] = *area;
+
+    return 0;
+}
+
+/*
+ * Start over with all of bounds free.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int spaceinit(struct freespace *space, const struct area *bounds)
+{
+    uint32_t i;
+
+    space->num = 0;
+    space->unused = -1;
+    for (i = space->size; i > 0; i --)
+    {
+        space->rects[i - 1].live = false;
+        space->rects[i - 1].next = space->unused;
+        space->unused = i - 1;
+    }
+
+    for (i = 0; i < SPACECLASSES * SPACECLASSES; i ++)
+    {
+        space->classes[i] = -1;
+    }
+
+    for (i = 0; i < SPACECELLS; i ++)
+    {
+        space->cells[i].num = 0;
+    }
+
+    space->bounds = *bounds;
+    space->cellwidth = (bounds->width + SPACEGRID - 1) / SPACEGRID;
+    space->cellheight = (bounds->height + SPACEGRID - 1) / SPACEGRID;
+    if (space->cellwidth < 1)
+    {
+        space->cellwidth = 1;
+    }
+    if (space->cellheight < 1)
+    {
+        space->cellheight = 1;
+    }
+
+    if (bounds->width > 0 && bounds->height > 0
+        && -1 == addrect(space, bounds))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Remove used from the free space.
+ *
+ * Every free rectangle used overlaps is replaced by the at most four
+ * largest rectangles around used inside it. New rectangles inside
+ * other free rectangles are thrown away so the set stays small. We
+ * only look at the free rectangles near used.
+ *
+ * Returns 0 on success, -1 if out of memory. The free space is then
+ * smaller than it should be, but still free.
+ */
+int spaceuse(struct freespace *space, const struct area *used)
+{
+    struct area rect;
+    struct area split[4];
+    void *hits;
+    int32_t hit;
+    int32_t num;
+    int32_t id;
+    int32_t i;
+    int32_t k;
+    int nsplit;
+    int j;
+    int ret = 0;
+
+    if (used->width <= 0 || used->height <= 0)
+    {
+        return 0;
+    }
+
+    hit = search(space, used, 0);
+    if (-1 == hit)
+    {
+        return -1;
+    }
+
+    /* Room for the new rectangles. */
+    hits = space->hits;
+    if (0 != grow(&hits, &space->hitsize, hit * 5 + 1, sizeof (uint32_t)))
+    {
+        return -1;
+    }
+    space->hits = hits;
+
+    /*
+     * A rectangle split from one we hit can't be inside another one
+     * we hit, unless it's also inside one of the other one's parts.
+     * So we can split them one at a time. The rectangles we didn't
+     * hit were not inside each other before, and none of them can be
+     * inside a new one, which is part of a rectangle they weren't
+     * inside either. So we only have to look for new rectangles
+     * inside a new one. We keep those after the hits.
+     */
+    for (i = 0, num = hit; i < hit; i ++)
+    {
+        rect = space->rects[space->hits[i]].area;
+        delrect(space, space->hits[i]);
+
+        nsplit = splitrect(&rect, used, split);
+        for (j = 0; j < nsplit; j ++)
+        {
+            if (covered(space, &split[j]))
+            {
+                continue;
+            }
+
+            for (k = hit; k < num; )
+            {
+                if (inside(&space->rects[space->hits[k]].area, &split[j]))
+                {
+                    delrect(space, space->hits[k]);
+                    space->hits[k] = space->hits[-- num];
+                }
+                else
+                {
+                    k ++;
+                }
+            }
+
+            id = addrect(space, &split[j]);
+            if (-1 == id)
+            {
+                ret = -1;
+                continue;
+            }
+
+            space->hits[num ++] = id;
+        }
+    }
+
+    return ret;
+}
+
+/* Check if a and b share any rows or columns. */
+static int aligned(const struct area *a, const struct area *b)
+{
+    return (a->x < b->x + b->width && b->x < a->x + a->width)
+        || (a->y < b->y + b->height && b->y < a->y + a->height);
+}
+
+/* Find the smallest area around the num rectangles in rects. */
+static void span(const struct area *rects, uint32_t num, struct area *box)
+{
+    int32_t right;
+    int32_t bottom;
+    uint32_t i;
+
+    *box = rects[0];
+
+    for (i = 1; i < num; i ++)
+    {
+        right = box->x + box->width;
+        if (rects[i].x + rects[i].width > right)
+        {
+            right = rects[i].x + rects[i].width;
+        }
+
+        bottom = box->y + box->height;
+        if (rects[i].y + rects[i].height > bottom)
+        {
+            bottom = rects[i].y + rects[i].height;
+        }
+
+        if (rects[i].x < box->x)
+        {
+            box->x = rects[i].x;
+        }
+
+        if (rects[i].y < box->y)
+        {
+            box->y = rects[i].y;
+        }
+
+        box->width = right - box->x;
+        box->height = bottom - box->y;
+    }
+}
+
+/*
+ * Split the *num rectangles in space->queue around used, keeping only
+ * the parts that overlap freed and aren't inside another one.
+ *
+ * As in spaceuse(), a new rectangle can only be inside another
+ * rectangle or a newer one, and no rectangle we kept can be inside a
+ * new one.
+ *
+ * Returns 1 if any rectangle was split, 0 if not, or -1 if out of
+ * memory.
+ */
+static int cut(struct freespace *space, const struct area *freed,
+               const struct area *used, uint32_t *num)
+{
+    struct area split[4];
+    uint32_t head;
+    uint32_t parts = *num;
+    uint32_t i;
+    int changed = 0;
+    int nsplit;
+    int s;
+
+    for (head = 0; head < parts; head ++)
+    {
+        if (0 == space->queue[head].width
+            || !overlaps(&space->queue[head], used))
+        {
+            continue;
+        }
+
+        nsplit = splitrect(&space->queue[head], used, split);
+        space->queue[head].width = 0;
+        changed = 1;
+
+        for (s = 0; s < nsplit; s ++)
+        {
+            if (!overlaps(&split[s], freed))
+            {
+                continue;
+            }
+
+            for (i = 0; i < *num; i ++)
+            {
+                if (0 != space->queue[i].width
+                    && inside(&split[s], &space->queue[i]))
+                {
+                    break;
+                }
+            }
+
+            if (i < *num)
+            {
+                continue;
+            }
+
+            for (i = parts; i < *num; i ++)
+            {
+                if (inside(&space->queue[i], &split[s]))
+                {
+                    space->queue[i].width = 0;
+                }
+            }
+
+            if (0 != enqueue(space, &split[s], num))
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (changed)
+    {
+        for (head = 0, parts = 0; head < *num; head ++)
+        {
+            if (0 != space->queue[head].width)
+            {
+                space->queue[parts ++] = space->queue[head];
+            }
+        }
+
+        *num = parts;
+    }
+
+    return changed;
+}
+
+/*
+ * Give back freed to the free space. The num areas in others are
+ * everything still in use.
+ *
+ * The free rectangles that change are the ones that now reach into
+ * freed. We find them the same way we'd build the free space from
+ * scratch, but only keep rectangles that overlap freed. Windows in
+ * line with freed cut them down the most, so we start with those, and
+ * then skip the windows that are nowhere near what's left. The free
+ * rectangles inside the new ones are thrown away.
+ *
+ * Returns 0 on success, -1 if out of memory. The free space is then
+ * smaller than it should be, but still free.
+ */
+int spacegive(struct freespace *space, const struct area *freed,
+              const struct area *others, uint32_t num)
+{
+    struct area box;
+    uint32_t tail = 0;
+    uint32_t i;
+    int pass;
+    int ret;
+
+    if (freed->width <= 0 || freed->height <= 0
+        || !overlaps(freed, &space->bounds))
+    {
+        return 0;
+    }
+
+    if (0 != enqueue(space, &space->bounds, &tail))
+    {
+        return -1;
+    }
+
+    box = space->bounds;
+
+    for (pass = 0; pass < 2; pass ++)
+    {
+        for (i = 0; i < num && 0 != tail; i ++)
+        {
+            if (aligned(&others[i], freed) != (0 == pass)
+                || !overlaps(&others[i], &box))
+            {
+                continue;
+            }
+
+            ret = cut(space, freed, &others[i], &tail);
+            if (-1 == ret)
+            {
+                return -1;
+            }
+
+            if (1 == ret && 0 != tail)
+            {
+                span(space->queue, tail, &box);
+            }
+        }
+    }
+
+    for (i = 0; i < tail; i ++)
+    {
+        if (-1 == addfree(space, &space->queue[i]))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Find the best free place for something width by height large. We
+ * prefer the place where it fits most snugly, then the one highest
+ * up, then the one furthest to the left.
+ *
+ * We look through the size classes where it fits in order of how
+ * snugly it could fit at best, and stop when no class left can do
+ * better than what we found.
+ *
+ * Returns 1 and stores the place in *found if there is one, otherwise
+ * 0.
+ */
+int spacefind(const struct freespace *space, int32_t width, int32_t height,
+              struct area *found)
+{
+    const struct area *rect;
+    const struct area *best = NULL;
+    int32_t order[SPACECLASSES * SPACECLASSES];
+    int32_t bound[SPACECLASSES * SPACECLASSES];
+    int32_t fit;
+    int32_t bestfit = 0;
+    int32_t id;
+    int32_t wfit;
+    int32_t hfit;
+    int num = 0;
+    int wclass;
+    int hclass;
+    int class;
+    int i;
+    int j;
+
+    if (0 == space->num || width <= 0 || height <= 0)
+    {
+        return 0;
+    }
+
+    /*
+     * The classes where it might fit, sorted on the best fit any
+     * rectangle in them could give.
+     */
+    for (wclass = sizeclass(width); wclass < SPACECLASSES; wclass ++)
+    {
+        for (hclass = sizeclass(height); hclass < SPACECLASSES; hclass ++)
+        {
+            class = wclass * SPACECLASSES + hclass;
+            if (-1 == space->classes[class])
+            {
+                continue;
+            }
+
+            wfit = (1 << wclass) - width;
+            hfit = (1 << hclass) - height;
+            fit = wfit < hfit ? wfit : hfit;
+            if (fit < 0)
+            {
+                fit = 0;
+            }
+
+            for (j = num; j > 0 && bound[j - 1] > fit; j --)
+            {
+                order[j] = order[j - 1];
+                bound[j] = bound[j - 1];
+            }
+            order[j] = class;
+            bound[j] = fit;
+            num ++;
+        }
+    }
+
+    for (i = 0; i < num; i ++)
+    {
+        if (NULL != best && bound[i] > bestfit)
+        {
+            break;
+        }
+
+        for (id = space->classes[order[i]]; -1 != id;
+             id = space->rects[id].next)
+        {
+            rect = &space->rects[id].area;
+
+            if (rect->width < width || rect->height < height)
+            {
+                continue;
+            }
+
+            fit = rect->width - width;
+            if (rect->height - height < fit)
+            {
+                fit = rect->height - height;
+            }
+
+            if (NULL == best || fit < bestfit
+                || (fit == bestfit
+                    && (rect->y < best->y
+                        || (rect->y == best->y && rect->x < best->x))))
+            {
+                best = rect;
+                bestfit = fit;
+            }
+        }
+    }
+
+    if (NULL == best)
+    {
+        return 0;
+    }
+
+    found->x = best->x;
+    found->y = best->y;
+    found->width = width;
+    found->height = height;
+
+    return 1;
+}
+
+/*
+ * Free all memory used by space.
+ */
+void spacefree(struct freespace *space)
+{
+    uint32_t i;
+
+    for (i = 0; i < SPACECELLS; i ++)
+    {
+        free(space->cells[i].ids);
+    }
+
+    free(space->rects);
+    free(space->hits);
+    free(space->queue);
+
+    memset(space, 0, sizeof (struct freespace));
+}
+
+#ifdef PLACEBENCH
+
+/*
+ * Micro benchmark of placing windows one after another on a 4K
+ * monitor, of moving each of them somewhere else, and of building the
+ * free space from scratch with that many windows already there. Build
+ * with:
+ *
+ *   cc -O2 -DPLACEBENCH place.c -o placebench
+ *
+ * Also checks that the free space we kept up to date while moving is
+ * the same as the one we built from scratch, and exits with 1 if not.
+ */
+
+#include <time.h>
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Check if every free rectangle in a is inside one in b. */
+static int within(const struct freespace *a, const struct freespace *b)
+{
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < a->size; i ++)
+    {
+        if (!a->rects[i].live)
+        {
+            continue;
+        }
+
+        for (j = 0; j < b->size; j ++)
+        {
+            if (b->rects[j].live
+                && inside(&a->rects[i].area, &b->rects[j].area))
+            {
+                break;
+            }
+        }
+
+        if (j == b->size)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    const uint32_t counts[] = { 10, 50, 100, 200, 500, 1000 };
+    const struct area bounds = { 0, 0, 3840, 2160 };
+    unsigned c;
+    int same = 1;
+
+    printf("windows  placed  free rects  ns/placement  ns/move"
+           "  rebuild us\n");
+
+    for (c = 0; c < sizeof counts / sizeof counts[0]; c ++)
+    {
+        struct freespace space;
+        struct freespace built;
+        struct area *wins;
+        struct area *others;
+        struct area found;
+        struct area old;
+        double start;
+        double placens;
+        double movens;
+        double rebuildus;
+        uint32_t placed = 0;
+        uint32_t num;
+        uint32_t i;
+        uint32_t j;
+
+        memset(&space, 0, sizeof (struct freespace));
+        memset(&built, 0, sizeof (struct freespace));
+
+        wins = calloc(counts[c], sizeof (struct area));
+        others = calloc(counts[c], sizeof (struct area));
+        if (NULL == wins || NULL == others || 0 != spaceinit(&space, &bounds))
+        {
+            exit(1);
+        }
+
+        srand(1);
+
+        /* Small windows, so hundreds of them fit. */
+        start = now();
+        for (i = 0; i < counts[c]; i ++)
+        {
+            int32_t width = 40 + rand() % 120;
+            int32_t height = 30 + rand() % 90;
+
+            if (spacefind(&space, width, height, &found))
+            {
+                wins[placed ++] = found;
+                spaceuse(&space, &found);
+            }
+        }
+        placens = (now() - start) / counts[c];
+
+        /*
+         * What we do when a window moved: give back where it was and
+         * use where it is now. Collecting the other windows is part
+         * of it.
+         */
+        start = now();
+        for (i = 0; i < placed; i ++)
+        {
+            old = wins[i];
+            wins[i].x = rand() % (bounds.width - old.width);
+            wins[i].y = rand() % (bounds.height - old.height);
+
+            for (j = 0, num = 0; j < placed; j ++)
+            {
+                if (j != i)
+                {
+                    others[num ++] = wins[j];
+                }
+            }
+
+            spacegive(&space, &old, others, num);
+            spaceuse(&space, &wins[i]);
+        }
+        movens = placed ? (now() - start) / placed : 0;
+
+        /* What we do when we've lost track. */
+        start = now();
+        spaceinit(&built, &bounds);
+        for (i = 0; i < placed; i ++)
+        {
+            spaceuse(&built, &wins[i]);
+        }
+        rebuildus = (now() - start) / 1000;
+
+        printf("%7u  %6u  %10u  %12.1f  %7.1f  %10.1f\n", counts[c], placed,
+               space.num, placens, movens, rebuildus);
+
+        if (!within(&space, &built) || !within(&built, &space))
+        {
+            fprintf(stderr, "placebench: Free space after moving %u windows "
+                    "differs from the one built from scratch.\n", placed);
+            same = 0;
+        }
+
+        spacefree(&built);
+        spacefree(&space);
+        free(others);
+        free(wins);
+    }
+
+    exit(same ? 0 : 1);
+}
+
+#endif /* PLACEBENCH */
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Cells along each side of the finest level of the grid we find
+ * rectangles in. Every level above has half as many.
+ */
+#define SPACEGRID 16
+#define SPACELEVELS 5
+#define SPACECELLS ((SPACEGRID * SPACEGRID * 4 - 1) / 3)
+
+/* Size classes along each side. Class c holds sizes 2^c to 2^(c+1) - 1. */
+#define SPACECLASSES 16
+
+/* A rectangle. */
+struct area
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+/* A free rectangle, or an unused slot for one. */
+struct freerect
+{
+    struct area area;
+    int32_t prev;               /* Free rectangles of the same size. */
+    int32_t next;               /* Same, or next unused slot. -1 ends. */
+    uint32_t seen;              /* Last search that found it. */
+    uint8_t class;              /* Size class, width class * SPACECLASSES
+                                 * + height class. */
+    uint8_t level;              /* Level of the grid it's listed on. */
+    bool live;                  /* Holds a free rectangle. */
+};
+
+/* The free rectangles that overlap one cell of the grid. */
+struct spacecell
+{
+    uint32_t *ids;
+    uint32_t num;
+    uint32_t size;
+};
+
+/*
+ * The free space left in some area after windows have been put there,
+ * kept as a set of large empty rectangles. The rectangles often
+ * overlap each other.
+ *
+ * To find the rectangles near a place, every rectangle is listed in
+ * the cells of a grid over the area it overlaps, on the finest level
+ * of the grid where that's at most four cells. To find the ones
+ * big enough for a window, they're also kept on lists by size class.
+ *
+ * Must be all zero before the first spaceinit().
+ */
+struct freespace
+{
+    struct freerect *rects;
+    uint32_t size;              /* Room for this many. */
+    uint32_t num;               /* Number of free rectangles. */
+    int32_t unused;             /* First unused slot. -1 if none. */
+    int32_t classes[SPACECLASSES * SPACECLASSES]; /* Lists by size. */
+    struct area bounds;         /* The whole area. */
+    int32_t cellwidth;
+    int32_t cellheight;
+    struct spacecell cells[SPACECELLS]; /* All levels, finest first. */
+    uint32_t stamp;             /* Number of the current search. */
+    uint32_t *hits;             /* What searches found. */
+    uint32_t hitsize;
+    struct area *queue;         /* Rectangles spacegive() is making. */
+    uint32_t queuesize;
+};
+
+/*
+ * Start over with all of bounds free.
+ *
+ * Returns 0 on success, -1 if out of memory.
+ */
+int spaceinit(struct freespace *space, const struct area *bounds);
+
+/*
+ * Remove used from the free space.
+ *
+ * Returns 0 on success, -1 if out of memory. The free space is then
+ * smaller than it should be, but still free.
+ */
+int spaceuse(struct freespace *space, const struct area *used);
+
+/*
+ * Give back freed to the free space. The num areas in others are
+ * everything still in use.
+ *
+ * Returns 0 on success, -1 if out of memory. The free space is then
+ * smaller than it should be, but still free.
+ */
+int spacegive(struct freespace *space, const struct area *freed,
+              const struct area *others, uint32_t num);
+
+/*
+ * Find the best free place for something width by height large. We
+ * prefer the place where it fits most snugly, then the one highest
+ * up, then the one furthest to the left.
+ *
+ * Returns 1 and stores the place in *found if there is one, otherwise
+ * 0.
+ */
+int spacefind(const struct freespace *space, int32_t width, int32_t height,
+              struct area *found);
+
+/*
+ * Free all memory used by space.
+ */
+void spacefree(struct freespace *space);